@@ -0,0 +1,249 @@
+#include "batch_eval.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && BATCH_LANE_BITS <= 32
+#define BATCH_X86 1
+#include <immintrin.h>
+#else
+#define BATCH_X86 0
+#endif
+
+// Instruction sets batch_eval can use
+typedef enum {
+  BATCH_ISA_UNKNOWN,
+  BATCH_ISA_SCALAR,
+  BATCH_ISA_SSE2,
+  BATCH_ISA_AVX2
+} BatchIsa;
+
+// Instruction set picked on the first call
+static BatchIsa batch_isa = BATCH_ISA_UNKNOWN;
+
+// ----------------------------------------
+// Vector helpers
+// ----------------------------------------
+
+#if BATCH_X86
+#if BATCH_LANE_BITS == 16
+#define SSE_LANES 8
+#define AVX_LANES 16
+#define SSE_SET1(v) _mm_set1_epi16((short)(v))
+#define SSE_CMPEQ(a, b) _mm_cmpeq_epi16(a, b)
+#define AVX_SET1(v) _mm256_set1_epi16((short)(v))
+#define AVX_CMPEQ(a, b) _mm256_cmpeq_epi16(a, b)
+#else
+#define SSE_LANES 4
+#define AVX_LANES 8
+#define SSE_SET1(v) _mm_set1_epi32((int)(v))
+#define SSE_CMPEQ(a, b) _mm_cmpeq_epi32(a, b)
+#define AVX_SET1(v) _mm256_set1_epi32((int)(v))
+#define AVX_CMPEQ(a, b) _mm256_cmpeq_epi32(a, b)
+#endif
+
+/*
+The function batch_eval_sse2 evaluates SSE_LANES boards per instruction. For
+every window the masks are ANDed with the window and compared with it; a lane
+becomes all ones when its board covers the window. The per-lane results are
+turned into flags and narrowed to bytes. It returns the number of boards done;
+the rest is left to the scalar path.
+*/
+__attribute__((target("sse2"))) static size_t
+batch_eval_sse2(const BatchMask *x, const BatchMask *o, uint8_t *flags,
+                const size_t count) {
+  __m128i lines[BB_LINE_COUNT];
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i full = SSE_SET1(BB_FULL);
+  const __m128i win_x = SSE_SET1(BATCH_WIN_X);
+  const __m128i win_o = SSE_SET1(BATCH_WIN_O);
+  const __m128i is_full = SSE_SET1(BATCH_FULL);
+  size_t i = 0;
+
+  // Broadcast every window mask once
+  for (uint l = 0; l < BB_LINE_COUNT; l++) {
+    lines[l] = SSE_SET1(bb_lines[l]);
+  }
+
+  for (; i + SSE_LANES <= count; i += SSE_LANES) {
+    __m128i vx = _mm_loadu_si128((const __m128i *)(x + i));
+    __m128i vo = _mm_loadu_si128((const __m128i *)(o + i));
+    __m128i wx = zero;
+    __m128i wo = zero;
+
+    // Check every window for both players
+    for (uint l = 0; l < BB_LINE_COUNT; l++) {
+      wx = _mm_or_si128(wx, SSE_CMPEQ(_mm_and_si128(vx, lines[l]), lines[l]));
+      wo = _mm_or_si128(wo, SSE_CMPEQ(_mm_and_si128(vo, lines[l]), lines[l]));
+    }
+    __m128i f = SSE_CMPEQ(_mm_or_si128(vx, vo), full);
+
+    // Turn the lane masks into flags
+    __m128i r = _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(wx, win_x), _mm_and_si128(wo, win_o)),
+        _mm_and_si128(f, is_full));
+
+    // Narrow the lanes to bytes and store them
+#if BATCH_LANE_BITS == 16
+    _mm_storel_epi64((__m128i *)(flags + i), _mm_packus_epi16(r, zero));
+#else
+    int packed = _mm_cvtsi128_si32(
+        _mm_packus_epi16(_mm_packs_epi32(r, zero), zero));
+    memcpy(flags + i, &packed, sizeof(packed));
+#endif
+  }
+  return i;
+}
+
+/*
+The function batch_eval_avx2 is batch_eval_sse2 with 256 bit registers, so it
+evaluates AVX_LANES boards per instruction.
+*/
+__attribute__((target("avx2"))) static size_t
+batch_eval_avx2(const BatchMask *x, const BatchMask *o, uint8_t *flags,
+                const size_t count) {
+  __m256i lines[BB_LINE_COUNT];
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i full = AVX_SET1(BB_FULL);
+  const __m256i win_x = AVX_SET1(BATCH_WIN_X);
+  const __m256i win_o = AVX_SET1(BATCH_WIN_O);
+  const __m256i is_full = AVX_SET1(BATCH_FULL);
+  size_t i = 0;
+
+  // Broadcast every window mask once
+  for (uint l = 0; l < BB_LINE_COUNT; l++) {
+    lines[l] = AVX_SET1(bb_lines[l]);
+  }
+
+  for (; i + AVX_LANES <= count; i += AVX_LANES) {
+    __m256i vx = _mm256_loadu_si256((const __m256i *)(x + i));
+    __m256i vo = _mm256_loadu_si256((const __m256i *)(o + i));
+    __m256i wx = zero;
+    __m256i wo = zero;
+
+    // Check every window for both players
+    for (uint l = 0; l < BB_LINE_COUNT; l++) {
+      wx = _mm256_or_si256(wx,
+                           AVX_CMPEQ(_mm256_and_si256(vx, lines[l]), lines[l]));
+      wo = _mm256_or_si256(wo,
+                           AVX_CMPEQ(_mm256_and_si256(vo, lines[l]), lines[l]));
+    }
+    __m256i f = AVX_CMPEQ(_mm256_or_si256(vx, vo), full);
+
+    // Turn the lane masks into flags
+    __m256i r = _mm256_or_si256(
+        _mm256_or_si256(_mm256_and_si256(wx, win_x),
+                        _mm256_and_si256(wo, win_o)),
+        _mm256_and_si256(f, is_full));
+
+    // Narrow the lanes to bytes and store them
+    __m128i lo = _mm256_castsi256_si128(r);
+    __m128i hi = _mm256_extracti128_si256(r, 1);
+#if BATCH_LANE_BITS == 16
+    _mm_storeu_si128((__m128i *)(flags + i), _mm_packus_epi16(lo, hi));
+#else
+    _mm_storel_epi64(
+        (__m128i *)(flags + i),
+        _mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128()));
+#endif
+  }
+  return i;
+}
+#endif
+
+// ----------------------------------------
+// Batch evaluation functions
+// ----------------------------------------
+
+/*
+The function batch_pack sets one bit per X or O cell of every board, with the
+same cell numbering as the bitboards.
+*/
+void batch_pack(const char (*boards)[ROWS][COLS], BatchMask *x, BatchMask *o,
+                const size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    Bitboard bb;
+    bb_from_board(boards[i], &bb);
+    x[i] = (BatchMask)bb.x;
+    o[i] = (BatchMask)bb.o;
+  }
+}
+
+/*
+The function batch_eval_scalar checks every window of every board one at a
+time.
+*/
+void batch_eval_scalar(const BatchMask *x, const BatchMask *o, uint8_t *flags,
+                       const size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    uint8_t f = 0;
+
+    // Check every window for both players
+    for (uint l = 0; l < BB_LINE_COUNT; l++) {
+      BatchMask line = (BatchMask)bb_lines[l];
+      if ((x[i] & line) == line) {
+        f |= BATCH_WIN_X;
+      }
+      if ((o[i] & line) == line) {
+        f |= BATCH_WIN_O;
+      }
+    }
+
+    // Check if every cell is taken
+    if ((BbMask)(x[i] | o[i]) == BB_FULL) {
+      f |= BATCH_FULL;
+    }
+    flags[i] = f;
+  }
+}
+
+/*
+The function batch_detect picks the widest instruction set the CPU supports.
+*/
+static void batch_detect(void) {
+  batch_isa = BATCH_ISA_SCALAR;
+#if BATCH_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    batch_isa = BATCH_ISA_AVX2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    batch_isa = BATCH_ISA_SSE2;
+  }
+#endif
+}
+
+/*
+The function batch_eval picks the instruction set on the first call, runs the
+vector path over as many boards as fill whole registers and finishes the
+remaining boards with the scalar path.
+*/
+void batch_eval(const BatchMask *x, const BatchMask *o, uint8_t *flags,
+                const size_t count) {
+  size_t done = 0;
+
+  // Pick the instruction set once
+  if (batch_isa == BATCH_ISA_UNKNOWN) {
+    batch_detect();
+  }
+
+#if BATCH_X86
+  if (batch_isa == BATCH_ISA_AVX2) {
+    done = batch_eval_avx2(x, o, flags, count);
+  } else if (batch_isa == BATCH_ISA_SSE2) {
+    done = batch_eval_sse2(x, o, flags, count);
+  }
+#endif
+
+  // Boards that do not fill a whole register
+  batch_eval_scalar(x + done, o + done, flags + done, count - done);
+}
+
+/*
+The function batch_eval_isa returns the name of the instruction set in use.
+*/
+const char *batch_eval_isa(void) {
+  if (batch_isa == BATCH_ISA_UNKNOWN) {
+    batch_detect();
+  }
+  return batch_isa == BATCH_ISA_AVX2   ? "avx2"
+         : batch_isa == BATCH_ISA_SSE2 ? "sse2"
+                                       : "scalar";
+}
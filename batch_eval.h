@@ -0,0 +1,74 @@
+#ifndef __BATCH_EVAL_H__
+#define __BATCH_EVAL_H__
+
+#include "bitboard.h"
+#include <stdint.h>
+
+// Result flags of one board
+#define BATCH_WIN_X 0x01 // X has a winning window
+#define BATCH_WIN_O 0x02 // O has a winning window
+#define BATCH_FULL 0x04  // Every cell is taken
+
+// Boards are packed into the narrowest lane that holds every cell, so that a
+// vector register holds as many boards as possible: with 16 bit lanes SSE2
+// checks 8 boards and AVX2 16 boards per instruction, with 32 bit lanes 4 and
+// 8. Boards above 32 cells use the scalar path.
+#if BB_CELLS <= 16
+typedef uint16_t BatchMask;
+#define BATCH_LANE_BITS 16
+#elif BB_CELLS <= 32
+typedef uint32_t BatchMask;
+#define BATCH_LANE_BITS 32
+#else
+typedef uint64_t BatchMask;
+#define BATCH_LANE_BITS 64
+#endif
+
+// ----------------------------------------
+// Batch evaluation functions
+// ----------------------------------------
+
+/**
+ * @brief Packs character boards into struct-of-arrays masks
+ *
+ * @param boards The tic-tac-toe boards
+ * @param x Receives the X mask of every board
+ * @param o Receives the O mask of every board
+ * @param count Number of boards
+ */
+void batch_pack(const char (*boards)[ROWS][COLS], BatchMask *x, BatchMask *o,
+                const size_t count);
+
+/**
+ * @brief Computes the win and full flags of many boards
+ *
+ * Uses AVX2 or SSE2 when the CPU has them and the scalar path otherwise.
+ * bb_init must have been called.
+ *
+ * @param x X mask of every board
+ * @param o O mask of every board
+ * @param flags Receives BATCH_WIN_X, BATCH_WIN_O and BATCH_FULL of every board
+ * @param count Number of boards
+ */
+void batch_eval(const BatchMask *x, const BatchMask *o, uint8_t *flags,
+                const size_t count);
+
+/**
+ * @brief Scalar version of batch_eval, also used as the reference
+ *
+ * @param x X mask of every board
+ * @param o O mask of every board
+ * @param flags Receives the flags of every board
+ * @param count Number of boards
+ */
+void batch_eval_scalar(const BatchMask *x, const BatchMask *o, uint8_t *flags,
+                       const size_t count);
+
+/**
+ * @brief Returns the instruction set batch_eval uses on this CPU
+ *
+ * @return "avx2", "sse2" or "scalar".
+ */
+const char *batch_eval_isa(void);
+
+#endif
@@ -0,0 +1,554 @@
+#include "batch_eval.h"
+#include "eval.h"
+#include "game.h"
+#include "ultimate.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Micro-benchmarks of the game.c hot functions, of batch_eval, of the pattern
+// evaluator and of the ultimate engine (host build only)
+//   bench_game [--write-baseline FILE] [--baseline FILE] [--threshold PCT]
+//              [--seed N]
+// Every benchmark runs for at least BENCH_MIN_NS per repeat and the fastest of
+// BENCH_REPEATS repeats is kept. Results are printed on stderr and written to
+// --write-baseline as one JSON object per line. With --baseline, a benchmark
+// more than --threshold percent (default 10) slower than the stored ns/op, or
+// found on one side only, makes the program exit with status 1. Timings only
+// compare on the same machine, so the baseline is written locally first.
+
+#define BENCH_POSITIONS 4096     // Number of sampled positions
+#define BENCH_MIN_NS 50000000ull // Minimum duration of one repeat
+#define BENCH_REPEATS 5          // Number of repeats per benchmark
+#define BENCH_MAX 32             // Maximum number of benchmarks and results
+#define CELLS (ROWS * COLS)
+
+// Struct for storing one benchmark
+// @field name name used in the results
+// @field run function running the benchmark for a number of operations
+typedef struct {
+  const char *name;
+  void (*run)(uint64_t ops);
+} Bench;
+
+// Struct for storing one benchmark result
+// @field name name of the benchmark
+// @field ns_per_op nanoseconds per operation
+// @field cycles_per_op time stamp counter cycles per operation, 0 if unknown
+typedef struct {
+  char name[32];
+  double ns_per_op;
+  double cycles_per_op;
+} BenchResult;
+
+// Sampled positions and the player to move in each of them
+static char positions[BENCH_POSITIONS][ROWS][COLS];
+static char to_move[BENCH_POSITIONS];
+// Cursor values of the sampled positions
+static uint cursor[BENCH_POSITIONS];
+// Sampled positions packed for batch_eval, and its results
+static BatchMask batch_x[BENCH_POSITIONS];
+static BatchMask batch_o[BENCH_POSITIONS];
+static uint8_t batch_flags[BENCH_POSITIONS];
+// Evaluator states of the sampled positions, and an empty cell of each of them
+// (CELLS if the board is full)
+static EvalState eval_states[BENCH_POSITIONS];
+static uint eval_cell[BENCH_POSITIONS];
+// Search tree of the ultimate engine benchmark
+static UltTree ult_tree;
+// Sink keeping the compiler from removing the benchmarked calls
+static volatile uint32_t sink;
+
+// ----------------------------------------
+// Timing
+// ----------------------------------------
+
+/*
+The function bench_ns reads the monotonic clock in nanoseconds and bench_cycles
+reads the time stamp counter, or returns 0 where there is none.
+*/
+static uint64_t bench_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t bench_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// ----------------------------------------
+// Position sampling
+// ----------------------------------------
+
+// State of the random generator used for sampling
+static uint32_t bench_rng = 1;
+
+/*
+The function bench_xorshift is the random generator used for sampling.
+*/
+static uint32_t bench_xorshift(void) {
+  bench_rng ^= bench_rng << 13;
+  bench_rng ^= bench_rng >> 17;
+  bench_rng ^= bench_rng << 5;
+  return bench_rng;
+}
+
+/*
+The function bench_sample_positions fills the position table with positions of
+random games: a random number of random legal moves from the empty board,
+stopping early when a move wins. This gives the mix of early, middle and end
+game positions that the game functions see in play.
+*/
+static void bench_sample_positions(void) {
+  for (uint i = 0; i < BENCH_POSITIONS; i++) {
+    char(*board)[COLS] = positions[i];
+    char player = X;
+    uint plies = bench_xorshift() % CELLS;
+
+    memset(board, EMPTY, sizeof(positions[i]));
+    for (uint ply = 0; ply < plies; ply++) {
+      // Play a random empty cell
+      uint cell;
+      do {
+        cell = bench_xorshift() % CELLS;
+      } while (board[cell / COLS][cell % COLS] != EMPTY);
+      board[cell / COLS][cell % COLS] = player;
+      player = player == X ? O : X;
+
+      // Stop after a winning move
+      if (is_win(player == X ? O : X, (const char(*)[COLS])board)) {
+        break;
+      }
+    }
+    to_move[i] = player;
+    cursor[i] = bench_xorshift() % CELLS;
+  }
+  batch_pack((const char(*)[ROWS][COLS])positions, batch_x, batch_o,
+             BENCH_POSITIONS);
+
+  // Evaluator states and a random empty cell to play in each position
+  for (uint i = 0; i < BENCH_POSITIONS; i++) {
+    Bitboard bb;
+    bb_from_board((const char(*)[COLS])positions[i], &bb);
+    eval_from_board(&eval_states[i], &bb);
+    BbMask empty = bb_empty(&bb);
+    eval_cell[i] = CELLS;
+    if (empty != 0) {
+      uint skip = bench_xorshift() % __builtin_popcountll(empty);
+      while (skip-- > 0) {
+        empty &= empty - 1;
+      }
+      eval_cell[i] = __builtin_ctzll(empty);
+    }
+  }
+}
+
+/*
+The function bench_check_batch checks that batch_eval and batch_eval_scalar
+give every sampled position the status the game loop gets from is_win and
+is_tie, so status_loop and the batch benchmarks time the same answer.
+*/
+static bool bench_check_batch(void) {
+  static uint8_t flags[BENCH_POSITIONS];
+  static uint8_t scalar[BENCH_POSITIONS];
+
+  batch_eval(batch_x, batch_o, flags, BENCH_POSITIONS);
+  batch_eval_scalar(batch_x, batch_o, scalar, BENCH_POSITIONS);
+  for (uint i = 0; i < BENCH_POSITIONS; i++) {
+    const char(*board)[COLS] = (const char(*)[COLS])positions[i];
+    uint8_t status = (is_win(X, board) ? BATCH_WIN_X : 0) |
+                     (is_win(O, board) ? BATCH_WIN_O : 0) |
+                     (is_tie(board) ? BATCH_FULL : 0);
+    if (flags[i] != status || scalar[i] != status) {
+      fprintf(stderr,
+              "bench_game: batch_eval mismatch at position %u: %#x, scalar "
+              "%#x, game %#x\n",
+              i, flags[i], scalar[i], status);
+      return false;
+    }
+  }
+  return true;
+}
+
+// ----------------------------------------
+// Benchmarks
+// ----------------------------------------
+
+/*
+Each benchmark calls one game function ops times, cycling through the sampled
+positions, and stores a value derived from the results in sink.
+*/
+static void bench_is_win(uint64_t ops) {
+  uint32_t wins = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    uint p = i % BENCH_POSITIONS;
+    wins += is_win(to_move[p], (const char(*)[COLS])positions[p]);
+  }
+  sink = wins;
+}
+
+static void bench_is_tie(uint64_t ops) {
+  uint32_t ties = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    ties += is_tie((const char(*)[COLS])positions[i % BENCH_POSITIONS]);
+  }
+  sink = ties;
+}
+
+static void bench_is_empty_pos(uint64_t ops) {
+  uint32_t empty = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    uint p = i % BENCH_POSITIONS;
+    empty += is_empty_pos(cursor[p] / COLS, cursor[p] % COLS,
+                          (const char(*)[COLS])positions[p]);
+  }
+  sink = empty;
+}
+
+static void bench_place_piece(uint64_t ops) {
+  char board[ROWS][COLS];
+  memset(board, EMPTY, sizeof(board));
+  for (uint64_t i = 0; i < ops; i++) {
+    place_piece(i & 1 ? O : X, i % CELLS, board);
+  }
+  sink = board[0][0];
+}
+
+static void bench_update_position(uint64_t ops) {
+  uint moves = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    update_position(&moves);
+  }
+  sink = moves;
+}
+
+static void bench_debounce(uint64_t ops) {
+  // One input tick per operation, the level is held for DEBOUNCE_TICKS + 1
+  // ticks so that every other change is a debounced press
+  volatile BtnState btn = {.but_pin = BTN1};
+  uint32_t presses = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    hal_sim_set_input(BTN1, (i / (DEBOUNCE_TICKS + 1)) & 1);
+    update_btn_state(&btn);
+    presses += debounce(btn);
+  }
+  hal_sim_set_input(BTN1, LOW);
+  sink = presses;
+}
+
+static void bench_print_board(uint64_t ops) {
+  for (uint64_t i = 0; i < ops; i++) {
+    print_board((const char(*)[COLS])positions[i % BENCH_POSITIONS]);
+  }
+}
+
+/*
+The batch benchmarks compare the status of every board computed one call at a
+time (both wins and the tie, as the game loop does) with batch_eval. One
+operation is one board, so the ns/op values compare directly.
+*/
+static void bench_status_loop(uint64_t ops) {
+  uint32_t status = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    const char(*board)[COLS] =
+        (const char(*)[COLS])positions[i % BENCH_POSITIONS];
+    status += is_win(X, board) + is_win(O, board) * 2 + is_tie(board) * 4;
+  }
+  sink = status;
+}
+
+static void bench_batch(uint64_t ops,
+                        void (*eval)(const BatchMask *, const BatchMask *,
+                                     uint8_t *, const size_t)) {
+  for (uint64_t done = 0; done < ops; done += BENCH_POSITIONS) {
+    size_t n = ops - done < BENCH_POSITIONS ? ops - done : BENCH_POSITIONS;
+    eval(batch_x, batch_o, batch_flags, n);
+  }
+  sink = batch_flags[0];
+}
+
+static void bench_batch_eval(uint64_t ops) {
+  bench_batch(ops, batch_eval);
+}
+
+static void bench_batch_eval_scalar(uint64_t ops) {
+  bench_batch(ops, batch_eval_scalar);
+}
+
+/*
+The evaluator benchmarks compare a move and its undo on the incremental state
+(what a search does per node) with a full rescan of the board, scalar and
+vectorized. eval_status is the tracked counterpart of status_loop and
+eval_threats collects the winning cells of the player to move. One operation
+is one board.
+*/
+static void bench_eval_place(uint64_t ops) {
+  int32_t total = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    uint p = i % BENCH_POSITIONS;
+    if (eval_cell[p] == CELLS) {
+      continue;
+    }
+    eval_place(&eval_states[p], to_move[p], eval_cell[p]);
+    total += eval_score(&eval_states[p], to_move[p]);
+    eval_remove(&eval_states[p], to_move[p], eval_cell[p]);
+  }
+  sink = total;
+}
+
+static void bench_eval_status(uint64_t ops) {
+  uint32_t status = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    const EvalState *state = &eval_states[i % BENCH_POSITIONS];
+    status += eval_is_win(state, X) + eval_is_win(state, O) * 2 +
+              eval_is_tie(state) * 4;
+  }
+  sink = status;
+}
+
+static void bench_eval_threats(uint64_t ops) {
+  BbMask cells = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    uint p = i % BENCH_POSITIONS;
+    cells ^= eval_threat_cells(&eval_states[p], to_move[p]);
+  }
+  sink = (uint32_t)cells;
+}
+
+static void bench_eval_rescan(uint64_t ops,
+                              int32_t (*rescan)(const Bitboard *, uint8_t *,
+                                                uint8_t *)) {
+  int32_t total = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    total += rescan(&eval_states[i % BENCH_POSITIONS].bb, NULL, NULL);
+  }
+  sink = total;
+}
+
+static void bench_eval_rescan_vector(uint64_t ops) {
+  bench_eval_rescan(ops, eval_rescan);
+}
+
+static void bench_eval_rescan_scalar(uint64_t ops) {
+  bench_eval_rescan(ops, eval_rescan_scalar);
+}
+
+/*
+The ultimate engine benchmark counts one UCT iteration as one operation, from
+the empty 9x9 board, all of them in one search like a move of the engine. Once
+the pool is full the iterations stop expanding; how many of the last run did is
+reported after the results.
+*/
+static void bench_ult_search(uint64_t ops) {
+  UltBoard board;
+  ult_clear(&board);
+  ult_search_init(&ult_tree, &board, 1);
+  ult_run(&ult_tree, ops);
+  sink = ult_best_move(&ult_tree);
+}
+
+static const Bench benches[] = {
+    {"is_win", bench_is_win},
+    {"is_tie", bench_is_tie},
+    {"is_empty_pos", bench_is_empty_pos},
+    {"place_piece", bench_place_piece},
+    {"update_position", bench_update_position},
+    {"debounce", bench_debounce},
+    {"print_board", bench_print_board},
+    {"status_loop", bench_status_loop},
+    {"batch_eval_scalar", bench_batch_eval_scalar},
+    {"batch_eval", bench_batch_eval},
+    {"eval_place", bench_eval_place},
+    {"eval_status", bench_eval_status},
+    {"eval_threats", bench_eval_threats},
+    {"eval_rescan_scalar", bench_eval_rescan_scalar},
+    {"eval_rescan", bench_eval_rescan_vector},
+    {"ult_search", bench_ult_search},
+};
+
+// ----------------------------------------
+// Runner
+// ----------------------------------------
+
+/*
+The function bench_measure doubles the operation count until one run takes at
+least BENCH_MIN_NS, then keeps the fastest of BENCH_REPEATS runs of that size.
+*/
+static BenchResult bench_measure(const Bench *bench) {
+  BenchResult result;
+  uint64_t ops = 64;
+
+  // Calibrate the number of operations
+  while (true) {
+    uint64_t start = bench_ns();
+    bench->run(ops);
+    if (bench_ns() - start >= BENCH_MIN_NS || ops >= (1ull << 40)) {
+      break;
+    }
+    ops *= 2;
+  }
+
+  // Keep the fastest repeat
+  snprintf(result.name, sizeof(result.name), "%s", bench->name);
+  result.ns_per_op = 0;
+  result.cycles_per_op = 0;
+  for (int r = 0; r < BENCH_REPEATS; r++) {
+    uint64_t start_cycles = bench_cycles();
+    uint64_t start = bench_ns();
+    bench->run(ops);
+    double ns = (double)(bench_ns() - start) / ops;
+    double cycles = (double)(bench_cycles() - start_cycles) / ops;
+    if (r == 0 || ns < result.ns_per_op) {
+      result.ns_per_op = ns;
+      result.cycles_per_op = cycles;
+    }
+  }
+  return result;
+}
+
+/*
+The function bench_load_baseline reads a results file written by
+--write-baseline. It returns the number of results read.
+*/
+static int bench_load_baseline(const char *path, BenchResult *out) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    fprintf(stderr, "bench_game: cannot open baseline %s\n", path);
+    return -1;
+  }
+
+  int count = 0;
+  char line[256];
+  while (count < BENCH_MAX && fgets(line, sizeof(line), file) != NULL) {
+    if (sscanf(line, " {\"name\": \"%31[^\"]\", \"ns_per_op\": %lf",
+               out[count].name, &out[count].ns_per_op) == 2) {
+      count++;
+    }
+  }
+  fclose(file);
+  return count;
+}
+
+int main(int argc, char **argv) {
+  const char *write_path = NULL;
+  const char *baseline_path = NULL;
+  double threshold = 10.0;
+
+  // Parse the command line
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--write-baseline") == 0 && i + 1 < argc) {
+      write_path = argv[++i];
+    } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+      baseline_path = argv[++i];
+    } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      bench_rng = (uint32_t)strtoul(argv[++i], NULL, 0);
+      bench_rng = bench_rng ? bench_rng : 1;
+    } else {
+      fprintf(stderr,
+              "usage: %s [--write-baseline FILE] [--baseline FILE] "
+              "[--threshold PCT] [--seed N]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  // The game functions print to stdout, send that to a null sink
+  if (freopen("/dev/null", "w", stdout) == NULL) {
+    fprintf(stderr, "bench_game: cannot redirect stdout\n");
+    return 2;
+  }
+
+  hal_sim_reset();
+  bb_init();
+  eval_init();
+  ult_init();
+  bench_sample_positions();
+  if (!bench_check_batch()) {
+    return 2;
+  }
+  fprintf(stderr, "batch_eval: %s, %d bit lanes\n", batch_eval_isa(),
+          BATCH_LANE_BITS);
+  fprintf(stderr, "eval_rescan: %s, %d windows\n", eval_isa(), BB_LINE_COUNT);
+
+  // Run every benchmark
+  size_t count = sizeof(benches) / sizeof(benches[0]);
+  BenchResult results[BENCH_MAX];
+  for (size_t i = 0; i < count; i++) {
+    results[i] = bench_measure(&benches[i]);
+    fprintf(stderr, "%-20s %10.2f ns/op %10.1f cycles/op\n", results[i].name,
+            results[i].ns_per_op, results[i].cycles_per_op);
+  }
+  fprintf(stderr, "ult_search: pool full on %lu of %lu iterations\n",
+          (unsigned long)ult_tree.pool_full,
+          (unsigned long)ult_tree.iterations);
+
+  // Write the machine readable results
+  if (write_path != NULL) {
+    FILE *file = fopen(write_path, "w");
+    if (file == NULL) {
+      fprintf(stderr, "bench_game: cannot write %s\n", write_path);
+      return 2;
+    }
+    for (size_t i = 0; i < count; i++) {
+      fprintf(file,
+              "{\"name\": \"%s\", \"ns_per_op\": %.3f, \"cycles_per_op\": "
+              "%.1f}\n",
+              results[i].name, results[i].ns_per_op, results[i].cycles_per_op);
+    }
+    fclose(file);
+  }
+
+  // Compare against the baseline
+  int status = 0;
+  if (baseline_path != NULL) {
+    BenchResult baseline[BENCH_MAX];
+    int baseline_count = bench_load_baseline(baseline_path, baseline);
+    if (baseline_count < 0) {
+      return 2;
+    }
+    bool matched[BENCH_MAX] = {false};
+    for (size_t i = 0; i < count; i++) {
+      int j = 0;
+      while (j < baseline_count && strcmp(results[i].name, baseline[j].name)) {
+        j++;
+      }
+      if (j == baseline_count) {
+        fprintf(stderr, "bench_game: %s is not in the baseline\n",
+                results[i].name);
+        status = 1;
+        continue;
+      }
+      matched[j] = true;
+
+      double limit = baseline[j].ns_per_op * (1.0 + threshold / 100.0);
+      if (results[i].ns_per_op > limit) {
+        fprintf(stderr,
+                "bench_game: %s regressed: %.2f ns/op, baseline %.2f ns/op "
+                "(+%.0f%% allowed)\n",
+                results[i].name, results[i].ns_per_op, baseline[j].ns_per_op,
+                threshold);
+        status = 1;
+      }
+    }
+
+    // Benchmarks of the baseline that no longer run
+    for (int j = 0; j < baseline_count; j++) {
+      if (!matched[j]) {
+        fprintf(stderr, "bench_game: %s of the baseline did not run\n",
+                baseline[j].name);
+        status = 1;
+      }
+    }
+  }
+  return status;
+}
@@ -0,0 +1,138 @@
+#include "bitboard.h"
+
+BbMask bb_lines[BB_LINE_COUNT];
+uint16_t bb_cell_lines[BB_CELLS][BB_MAX_CELL_LINES];
+uint8_t bb_cell_line_count[BB_CELLS];
+
+// ----------------------------------------
+// Internal helpers
+// ----------------------------------------
+
+/*
+The function bb_add_line builds the mask of the window starting at (row, col)
+and going WIN_LENGTH cells in direction (d_row, d_col). The mask is stored at
+index line of bb_lines and the line index is added to the list of every cell
+it covers.
+*/
+static void bb_add_line(uint line, uint row, uint col, int d_row, int d_col) {
+  BbMask mask = 0;
+
+  // Walk WIN_LENGTH cells in the given direction
+  for (uint i = 0; i < WIN_LENGTH; i++) {
+    uint cell = (row + i * d_row) * COLS + (col + i * d_col);
+    mask |= 1ull << cell;
+
+    // Remember that this window goes through the cell
+    bb_cell_lines[cell][bb_cell_line_count[cell]++] = line;
+  }
+
+  bb_lines[line] = mask;
+}
+
+// ----------------------------------------
+// Bitboard functions
+// ----------------------------------------
+
+/*
+The function bb_init enumerates every window of WIN_LENGTH cells: horizontal,
+vertical, diagonal and anti-diagonal. For a 3x3 board with WIN_LENGTH 3 these
+are the 8 lines checked by is_win.
+*/
+void bb_init(void) {
+  uint line = 0;
+
+  // Start from empty per-cell lists
+  for (uint cell = 0; cell < BB_CELLS; cell++) {
+    bb_cell_line_count[cell] = 0;
+  }
+
+  // Horizontal windows
+  for (uint row = 0; row < ROWS; row++) {
+    for (uint col = 0; col + WIN_LENGTH <= COLS; col++) {
+      bb_add_line(line++, row, col, 0, 1);
+    }
+  }
+
+  // Vertical windows
+  for (uint row = 0; row + WIN_LENGTH <= ROWS; row++) {
+    for (uint col = 0; col < COLS; col++) {
+      bb_add_line(line++, row, col, 1, 0);
+    }
+  }
+
+  // Diagonal windows, going down and right
+  for (uint row = 0; row + WIN_LENGTH <= ROWS; row++) {
+    for (uint col = 0; col + WIN_LENGTH <= COLS; col++) {
+      bb_add_line(line++, row, col, 1, 1);
+    }
+  }
+
+  // Anti-diagonal windows, going down and left
+  for (uint row = 0; row + WIN_LENGTH <= ROWS; row++) {
+    for (uint col = WIN_LENGTH - 1; col < COLS; col++) {
+      bb_add_line(line++, row, col, 1, -1);
+    }
+  }
+}
+
+/*
+The function bb_from_board sets one bit in the X or O mask for every cell of the
+character board that holds X or O.
+*/
+void bb_from_board(const char (*board)[COLS], Bitboard *bb) {
+  bb->x = 0;
+  bb->o = 0;
+
+  // Loop over the rows and columns of the game board
+  for (uint row = 0; row < ROWS; row++) {
+    for (uint col = 0; col < COLS; col++) {
+      if (board[row][col] == X) {
+        bb->x |= 1ull << (row * COLS + col);
+      } else if (board[row][col] == O) {
+        bb->o |= 1ull << (row * COLS + col);
+      }
+    }
+  }
+}
+
+/*
+The function bb_to_board writes X, O or EMPTY into every cell of the character
+board according to the bitboard masks.
+*/
+void bb_to_board(const Bitboard *bb, char (*board)[COLS]) {
+  // Loop over the rows and columns of the game board
+  for (uint row = 0; row < ROWS; row++) {
+    for (uint col = 0; col < COLS; col++) {
+      BbMask bit = 1ull << (row * COLS + col);
+      board[row][col] = (bb->x & bit) ? X : (bb->o & bit) ? O : EMPTY;
+    }
+  }
+}
+
+/*
+The function bb_is_win checks every window; the player wins if all cells of a
+window are set in pieces.
+*/
+bool bb_is_win(const BbMask pieces) {
+  for (uint line = 0; line < BB_LINE_COUNT; line++) {
+    if ((pieces & bb_lines[line]) == bb_lines[line]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+The function bb_is_win_at is the incremental version of bb_is_win. A new piece
+can only complete a window that goes through its own cell, so only those
+windows are checked.
+*/
+bool bb_is_win_at(const BbMask pieces, const uint cell) {
+  for (uint i = 0; i < bb_cell_line_count[cell]; i++) {
+    BbMask mask = bb_lines[bb_cell_lines[cell][i]];
+    if ((pieces & mask) == mask) {
+      return true;
+    }
+  }
+  return false;
+}
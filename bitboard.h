@@ -0,0 +1,128 @@
+#ifndef __BITBOARD_H__
+#define __BITBOARD_H__
+
+#include "game.h"
+#include <stdint.h>
+
+#ifndef WIN_LENGTH
+#define WIN_LENGTH 3 // Number of pieces in a row needed to win
+#endif
+
+#define BB_CELLS (ROWS * COLS) // Number of cells, cell index is row * COLS + col
+
+// Number of horizontal, vertical and diagonal windows of WIN_LENGTH cells
+#define BB_H_LINES (ROWS * (COLS - WIN_LENGTH + 1))
+#define BB_V_LINES ((ROWS - WIN_LENGTH + 1) * COLS)
+#define BB_D_LINES ((ROWS - WIN_LENGTH + 1) * (COLS - WIN_LENGTH + 1))
+#define BB_LINE_COUNT (BB_H_LINES + BB_V_LINES + 2 * BB_D_LINES)
+
+// Maximum number of windows going through one cell
+#define BB_MAX_CELL_LINES (4 * WIN_LENGTH)
+
+// Mask with one bit set for every cell of the board
+#define BB_FULL (BB_CELLS == 64 ? ~0ull : ((1ull << BB_CELLS) - 1))
+
+_Static_assert(BB_CELLS <= 64, "bitboards hold at most 64 cells");
+_Static_assert(WIN_LENGTH <= ROWS && WIN_LENGTH <= COLS,
+               "WIN_LENGTH must fit on the board");
+
+// One bit per cell, bit index is row * COLS + col
+typedef uint64_t BbMask;
+
+// Struct for storing a board as one mask per player
+// @field x cells occupied by X
+// @field o cells occupied by O
+typedef struct {
+  BbMask x;
+  BbMask o;
+} Bitboard;
+
+// Masks of every winning window, filled by bb_init
+extern BbMask bb_lines[BB_LINE_COUNT];
+// Indices into bb_lines of the windows going through each cell
+extern uint16_t bb_cell_lines[BB_CELLS][BB_MAX_CELL_LINES];
+// Number of windows going through each cell
+extern uint8_t bb_cell_line_count[BB_CELLS];
+
+// ----------------------------------------
+// Bitboard functions
+// ----------------------------------------
+
+/**
+ * @brief Builds the window tables; must be called once before any other
+ * bitboard function
+ */
+void bb_init(void);
+
+/**
+ * @brief Converts a character board to a bitboard
+ *
+ * @param board The tic-tac-toe board.
+ * @param bb Pointer to the bitboard receiving the position
+ */
+void bb_from_board(const char (*board)[COLS], Bitboard *bb);
+
+/**
+ * @brief Converts a bitboard to a character board
+ *
+ * @param bb Pointer to the bitboard
+ * @param board The tic-tac-toe board receiving the position.
+ */
+void bb_to_board(const Bitboard *bb, char (*board)[COLS]);
+
+/**
+ * @brief Check if the given pieces contain a winning window.
+ *
+ * @param pieces Mask of one player's pieces
+ * @return True if one window is fully covered, False otherwise.
+ */
+bool bb_is_win(const BbMask pieces);
+
+/**
+ * @brief Check if the piece at cell completes a winning window.
+ *
+ * Only the windows going through cell are checked.
+ *
+ * @param pieces Mask of one player's pieces, including the piece at cell
+ * @param cell Index of the cell that was just played
+ * @return True if a window through cell is fully covered, False otherwise.
+ */
+bool bb_is_win_at(const BbMask pieces, const uint cell);
+
+/**
+ * @brief Returns the mask of one player's pieces
+ *
+ * @param bb Pointer to the bitboard
+ * @param player The player's character
+ * @return Mask of the player's pieces.
+ */
+static inline BbMask bb_pieces(const Bitboard *bb, const char player) {
+  return player == X ? bb->x : bb->o;
+}
+
+/**
+ * @brief Returns the mask of empty cells
+ *
+ * @param bb Pointer to the bitboard
+ * @return Mask of the empty cells.
+ */
+static inline BbMask bb_empty(const Bitboard *bb) {
+  return ~(bb->x | bb->o) & BB_FULL;
+}
+
+/**
+ * @brief Places a piece for player at cell
+ *
+ * @param bb Pointer to the bitboard
+ * @param player The player's character
+ * @param cell Index of the cell
+ */
+static inline void bb_place(Bitboard *bb, const char player, const uint cell) {
+  if (player == X) {
+    bb->x |= 1ull << cell;
+  } else {
+    bb->o |= 1ull << cell;
+  }
+}
+
+#endif
@@ -0,0 +1,402 @@
+#include "book.h"
+#include <string.h>
+#if !PICO_ON_DEVICE
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Cell mapping of every symmetry, original to canonical and back
+static uint8_t sym_map[8][BB_CELLS];
+static uint8_t sym_inv[8][BB_CELLS];
+
+// ----------------------------------------
+// Internal helpers
+// ----------------------------------------
+
+/*
+The function book_transform maps every set bit of mask through symmetry sym.
+*/
+static BbMask book_transform(BbMask mask, const uint sym) {
+  BbMask out = 0;
+  while (mask != 0) {
+    out |= 1ull << sym_map[sym][__builtin_ctzll(mask)];
+    mask &= mask - 1;
+  }
+  return out;
+}
+
+#if BB_CELLS > 32
+/*
+The function book_mix is the splitmix64 finalizer, used to hash boards that do
+not fit in a 64 bit key.
+*/
+static uint64_t book_mix(uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+  return value ^ (value >> 31);
+}
+#endif
+
+/*
+The function book_pack turns both masks of a position into a key. Boards up to
+32 cells fit exactly, larger boards are hashed.
+*/
+static uint64_t book_pack(const BbMask x, const BbMask o) {
+#if BB_CELLS <= 32
+  return x << 32 | o;
+#else
+  return book_mix(x) ^ book_mix(o ^ 0x9e3779b97f4a7c15ull);
+#endif
+}
+
+// ----------------------------------------
+// Book functions
+// ----------------------------------------
+
+/*
+The function book_init builds the cell mapping of every symmetry. The first four
+(identity, rotation by 180 degrees and the two mirrors) are valid on every
+board; the other four (rotations by 90 degrees and the two diagonal mirrors)
+only on square boards.
+*/
+void book_init(void) {
+  for (uint sym = 0; sym < BOOK_SYMS; sym++) {
+    for (uint row = 0; row < ROWS; row++) {
+      for (uint col = 0; col < COLS; col++) {
+        uint r = row;
+        uint c = col;
+
+        // Compute the mapped row and column
+        switch (sym) {
+        case 1: r = ROWS - 1 - row; c = COLS - 1 - col; break;
+        case 2: c = COLS - 1 - col; break;
+        case 3: r = ROWS - 1 - row; break;
+        case 4: r = col; c = COLS - 1 - row; break;
+        case 5: r = ROWS - 1 - col; c = row; break;
+        case 6: r = col; c = row; break;
+        case 7: r = ROWS - 1 - col; c = COLS - 1 - row; break;
+        }
+
+        sym_map[sym][row * COLS + col] = r * COLS + c;
+        sym_inv[sym][r * COLS + c] = row * COLS + col;
+      }
+    }
+  }
+}
+
+/*
+The function book_key packs the position in every symmetric orientation and
+keeps the smallest key.
+*/
+uint64_t book_key(const Bitboard *bb, uint *sym) {
+  uint64_t best = book_pack(bb->x, bb->o);
+  *sym = 0;
+
+  for (uint s = 1; s < BOOK_SYMS; s++) {
+    uint64_t key = book_pack(book_transform(bb->x, s), book_transform(bb->o, s));
+    if (key < best) {
+      best = key;
+      *sym = s;
+    }
+  }
+  return best;
+}
+
+/*
+The function book_map_cell maps a cell to or from the canonical orientation.
+*/
+uint book_map_cell(const uint sym, const uint cell, const bool to_canonical) {
+  return to_canonical ? sym_map[sym][cell] : sym_inv[sym][cell];
+}
+
+/*
+The function book_open_mem checks the header and sets the entry and index
+pointers into the data. Nothing is copied, so data can be a flash address. A
+header whose tables do not fit in size is rejected, so a truncated or corrupt
+book cannot send book_find outside the data.
+*/
+bool book_open_mem(Book *book, const void *data, const size_t size) {
+  const BookHeader *header = data;
+
+  // Check the header
+  if (size < sizeof(BookHeader) || header->magic != BOOK_MAGIC ||
+      header->version != BOOK_VERSION) {
+    return false;
+  }
+
+  // The book must have been built for this board
+  if (header->rows != ROWS || header->cols != COLS ||
+      header->win_length != WIN_LENGTH || header->block_entries == 0) {
+    return false;
+  }
+
+  // The entries and the index must be aligned and inside the data. The header
+  // fields come from the file, so the sizes are compared by division: a large
+  // count cannot wrap the products around.
+  if (header->entries_offset < sizeof(BookHeader) ||
+      header->entries_offset > size || header->index_offset > size ||
+      header->entries_offset % sizeof(uint64_t) != 0 ||
+      header->index_offset % sizeof(uint64_t) != 0 ||
+      header->entry_count >
+          (size - header->entries_offset) / sizeof(BookEntry) ||
+      header->index_count >
+          (size - header->index_offset) / sizeof(uint64_t)) {
+    return false;
+  }
+
+  // One index key per block, as book_find expects
+  if (header->index_count !=
+      (header->entry_count + header->block_entries - 1) /
+          header->block_entries) {
+    return false;
+  }
+
+  book->header = header;
+  book->entries =
+      (const BookEntry *)((const uint8_t *)data + header->entries_offset);
+  book->index = (const uint64_t *)((const uint8_t *)data + header->index_offset);
+  book->size = size;
+  book->mapped = false;
+  return true;
+}
+
+/*
+The function book_find does a binary search in the sparse index to find the
+block that can hold the key, then a binary search inside that block. Only the
+index and one block are touched, which keeps cold lookups to a few pages.
+*/
+const BookEntry *book_find(const Book *book, const uint64_t key) {
+  const BookHeader *header = book->header;
+
+  // Find the last block whose first key is not above the key
+  uint64_t lo = 0;
+  uint64_t hi = header->index_count;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (book->index[mid] <= key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) {
+    return NULL;
+  }
+
+  // Search the block
+  uint64_t first = (lo - 1) * header->block_entries;
+  lo = first;
+  hi = first + header->block_entries;
+  if (hi > header->entry_count) {
+    hi = header->entry_count;
+  }
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (book->entries[mid].key < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo < header->entry_count && book->entries[lo].key == key) {
+    return &book->entries[lo];
+  }
+  return NULL;
+}
+
+/*
+The function book_lookup finds the canonical entry of the position and maps its
+move back to the orientation of the position. A move on an occupied cell is
+never returned.
+*/
+bool book_lookup(const Book *book, const Bitboard *bb, int *move, int *score) {
+  uint sym;
+  const BookEntry *entry = book_find(book, book_key(bb, &sym));
+
+  if (entry == NULL || entry->move >= BB_CELLS) {
+    return false;
+  }
+
+  // Boards over 32 cells have hashed keys, a colliding entry may name an
+  // occupied cell
+  uint cell = book_map_cell(sym, entry->move, false);
+  if (((bb->x | bb->o) >> cell) & 1) {
+    return false;
+  }
+
+  *move = cell;
+  if (score != NULL) {
+    *score = entry->score;
+  }
+  return true;
+}
+
+#if !PICO_ON_DEVICE
+/*
+The function book_open_file maps the whole file read-only. Pages are loaded by
+the kernel on first access, so opening a large book is instant.
+*/
+bool book_open_file(Book *book, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  // Map the whole file
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  // Check the header and set the pointers
+  if (!book_open_mem(book, data, st.st_size)) {
+    munmap(data, st.st_size);
+    return false;
+  }
+  book->mapped = true;
+  return true;
+}
+
+/*
+The function book_close unmaps a book opened with book_open_file.
+*/
+void book_close(Book *book) {
+  if (book->mapped) {
+    munmap((void *)book->header, book->size);
+  }
+  book->header = NULL;
+  book->mapped = false;
+}
+
+/*
+The function book_writer_open writes a placeholder header; the real header is
+written by book_writer_close once the index is known.
+*/
+bool book_writer_open(BookWriter *writer, const char *path,
+                      const uint64_t entry_count) {
+  memset(writer, 0, sizeof(*writer));
+
+  // Fill in the header
+  writer->header.magic = BOOK_MAGIC;
+  writer->header.version = BOOK_VERSION;
+  writer->header.rows = ROWS;
+  writer->header.cols = COLS;
+  writer->header.win_length = WIN_LENGTH;
+  writer->header.block_entries = BOOK_BLOCK_ENTRIES;
+  writer->header.index_count =
+      (entry_count + BOOK_BLOCK_ENTRIES - 1) / BOOK_BLOCK_ENTRIES;
+  writer->header.entries_offset = sizeof(BookHeader);
+  writer->header.index_offset =
+      sizeof(BookHeader) + entry_count * sizeof(BookEntry);
+
+  // Room for the first key of every block
+  writer->index = malloc((writer->header.index_count + 1) * sizeof(uint64_t));
+  if (writer->index == NULL) {
+    return false;
+  }
+
+  // Open the file and reserve the header
+  writer->file = fopen(path, "wb");
+  if (writer->file == NULL ||
+      fwrite(&writer->header, sizeof(BookHeader), 1, writer->file) != 1) {
+    if (writer->file != NULL) {
+      fclose(writer->file);
+    }
+    free(writer->index);
+    return false;
+  }
+  return true;
+}
+
+/*
+The function book_writer_add appends one entry and records the key of the first
+entry of every block.
+*/
+bool book_writer_add(BookWriter *writer, const BookEntry *entry) {
+  uint64_t n = writer->header.entry_count;
+
+  // Keys must be strictly increasing
+  if (n > 0 && entry->key <= writer->last_key) {
+    return false;
+  }
+  if (n == writer->header.index_count * BOOK_BLOCK_ENTRIES) {
+    return false;
+  }
+
+  // Remember the first key of each block
+  if (n % BOOK_BLOCK_ENTRIES == 0) {
+    writer->index[n / BOOK_BLOCK_ENTRIES] = entry->key;
+  }
+
+  if (fwrite(entry, sizeof(BookEntry), 1, writer->file) != 1) {
+    return false;
+  }
+  writer->header.entry_count++;
+  writer->last_key = entry->key;
+  return true;
+}
+
+/*
+The function book_writer_close appends the sparse index and rewrites the header
+with the final entry count.
+*/
+bool book_writer_close(BookWriter *writer) {
+  FILE *file = writer->file;
+  BookHeader *header = &writer->header;
+
+  // The index was sized for the announced number of entries
+  header->index_count =
+      (header->entry_count + BOOK_BLOCK_ENTRIES - 1) / BOOK_BLOCK_ENTRIES;
+  header->index_offset =
+      sizeof(BookHeader) + header->entry_count * sizeof(BookEntry);
+
+  bool ok = fwrite(writer->index, sizeof(uint64_t), header->index_count,
+                   file) == header->index_count;
+  ok = ok && fseek(file, 0, SEEK_SET) == 0;
+  ok = ok && fwrite(header, sizeof(BookHeader), 1, file) == 1;
+  ok = fclose(file) == 0 && ok;
+
+  free(writer->index);
+  writer->index = NULL;
+  return ok;
+}
+
+/*
+The function book_compare orders entries by key for qsort.
+*/
+static int book_compare(const void *a, const void *b) {
+  uint64_t ka = ((const BookEntry *)a)->key;
+  uint64_t kb = ((const BookEntry *)b)->key;
+  return ka < kb ? -1 : ka > kb;
+}
+
+/*
+The function book_write sorts the entries and streams them through a writer.
+Entries with a duplicate key keep only the first one.
+*/
+bool book_write(const char *path, BookEntry *entries, const uint64_t count) {
+  BookWriter writer;
+
+  qsort(entries, count, sizeof(BookEntry), book_compare);
+  if (!book_writer_open(&writer, path, count)) {
+    return false;
+  }
+
+  bool ok = true;
+  for (uint64_t i = 0; i < count && ok; i++) {
+    if (i == 0 || entries[i].key != entries[i - 1].key) {
+      ok = book_writer_add(&writer, &entries[i]);
+    }
+  }
+  return book_writer_close(&writer) && ok;
+}
+#endif
@@ -0,0 +1,215 @@
+#ifndef __BOOK_H__
+#define __BOOK_H__
+
+#include "bitboard.h"
+#include <stdint.h>
+
+// Opening book file layout (little endian, the same on the RP2040 and x86):
+//   BookHeader
+//   BookEntry[entry_count]         sorted by key, split in blocks of
+//                                  block_entries entries
+//   uint64_t index[index_count]    first key of every block (sparse index)
+// The book is read in place: on the host through mmap, on the RP2040 from
+// flash through XIP, so lookups never copy or parse the file.
+
+#define BOOK_MAGIC 0x4B4F4254u  // "TBOK"
+#define BOOK_VERSION 1          // Version of the file layout
+#define BOOK_BLOCK_ENTRIES 256  // Entries per block, one index key per block
+#define BOOK_SYMS (ROWS == COLS ? 8 : 4) // Board symmetries used for keys
+
+// Struct for storing the book file header
+// @field magic BOOK_MAGIC
+// @field version BOOK_VERSION
+// @field rows number of rows of the board the book was built for
+// @field cols number of columns of the board the book was built for
+// @field win_length WIN_LENGTH of the board the book was built for
+// @field block_entries number of entries per block
+// @field entry_count number of entries
+// @field index_count number of index keys
+// @field entries_offset byte offset of the first entry
+// @field index_offset byte offset of the first index key
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint8_t rows;
+  uint8_t cols;
+  uint8_t win_length;
+  uint8_t reserved[3];
+  uint32_t block_entries;
+  uint64_t entry_count;
+  uint64_t index_count;
+  uint64_t entries_offset;
+  uint64_t index_offset;
+} BookHeader;
+
+// Struct for storing one book position
+// @field key canonical key of the position, see book_key
+// @field move best move as a cell index in the canonical orientation
+// @field score score for the player to move, -100 (lost) to 100 (won)
+// @field depth search depth or quality of the score, 0 if unknown
+typedef struct {
+  uint64_t key;
+  uint8_t move;
+  int8_t score;
+  uint8_t depth;
+  uint8_t reserved[5];
+} BookEntry;
+
+_Static_assert(sizeof(BookHeader) == 48, "BookHeader layout");
+_Static_assert(sizeof(BookEntry) == 16, "BookEntry layout");
+
+// Struct for storing an open book
+// @field header pointer to the header inside the book data
+// @field entries pointer to the entries inside the book data
+// @field index pointer to the sparse index inside the book data
+// @field size size of the book data in bytes
+// @field mapped true if the data was mapped by book_open_file
+typedef struct {
+  const BookHeader *header;
+  const BookEntry *entries;
+  const uint64_t *index;
+  size_t size;
+  bool mapped;
+} Book;
+
+// ----------------------------------------
+// Book functions
+// ----------------------------------------
+
+/**
+ * @brief Builds the symmetry tables; must be called once after bb_init
+ */
+void book_init(void);
+
+/**
+ * @brief Computes the canonical key of a position
+ *
+ * The key is the smallest key over all board symmetries, so symmetric
+ * positions share one entry. Boards up to 32 cells are packed exactly, larger
+ * boards are hashed.
+ *
+ * @param bb Pointer to the position
+ * @param sym Receives the symmetry that gives the canonical orientation
+ * @return The canonical key.
+ */
+uint64_t book_key(const Bitboard *bb, uint *sym);
+
+/**
+ * @brief Maps a cell between the original and the canonical orientation
+ *
+ * @param sym Symmetry returned by book_key
+ * @param cell Cell index
+ * @param to_canonical true to map to the canonical orientation, false to map
+ * back
+ * @return The mapped cell index.
+ */
+uint book_map_cell(const uint sym, const uint cell, const bool to_canonical);
+
+/**
+ * @brief Opens a book stored in memory, e.g. in flash
+ *
+ * @param book Pointer to the book
+ * @param data Start of the book data, 8 byte aligned
+ * @param size Size of the book data in bytes
+ * @return true if the data is a valid book for this board, false otherwise.
+ */
+bool book_open_mem(Book *book, const void *data, const size_t size);
+
+/**
+ * @brief Finds the entry of a key
+ *
+ * @param book Pointer to the book
+ * @param key Canonical key
+ * @return Pointer to the entry inside the book data, or NULL if not found.
+ */
+const BookEntry *book_find(const Book *book, const uint64_t key);
+
+/**
+ * @brief Looks up the best move of a position
+ *
+ * @param book Pointer to the book
+ * @param bb Pointer to the position
+ * @param move Receives the best move as a cell index of the position
+ * @param score Receives the score for the player to move, may be NULL
+ * @return true if the position is in the book with a move on an empty cell,
+ * false otherwise.
+ */
+bool book_lookup(const Book *book, const Bitboard *bb, int *move, int *score);
+
+#ifdef OPENING_BOOK
+// Book linked into the firmware, generated by book_tool carray
+extern const uint8_t book_data[];
+extern const size_t book_data_size;
+#endif
+
+#if !PICO_ON_DEVICE
+// Struct for storing a book being written
+// @field file output file
+// @field header header written when the book is closed
+// @field index first key of every block
+// @field last_key key of the last entry added
+typedef struct {
+  void *file;
+  BookHeader header;
+  uint64_t *index;
+  uint64_t last_key;
+} BookWriter;
+
+/**
+ * @brief Maps a book file into memory without copying it (host only)
+ *
+ * @param book Pointer to the book
+ * @param path Path of the book file
+ * @return true if the file is a valid book for this board, false otherwise.
+ */
+bool book_open_file(Book *book, const char *path);
+
+/**
+ * @brief Unmaps a book opened with book_open_file (host only)
+ *
+ * @param book Pointer to the book
+ */
+void book_close(Book *book);
+
+/**
+ * @brief Starts writing a book file (host only)
+ *
+ * @param writer Pointer to the writer
+ * @param path Path of the book file
+ * @param entry_count Number of entries that will be added
+ * @return true on success, false otherwise.
+ */
+bool book_writer_open(BookWriter *writer, const char *path,
+                      const uint64_t entry_count);
+
+/**
+ * @brief Appends an entry, entries must be added in increasing key order
+ * (host only)
+ *
+ * @param writer Pointer to the writer
+ * @param entry The entry to add
+ * @return true on success, false on a write error or an out of order key.
+ */
+bool book_writer_add(BookWriter *writer, const BookEntry *entry);
+
+/**
+ * @brief Writes the sparse index and the header and closes the file (host
+ * only)
+ *
+ * @param writer Pointer to the writer
+ * @return true on success, false otherwise.
+ */
+bool book_writer_close(BookWriter *writer);
+
+/**
+ * @brief Sorts entries by key and writes them as a book file (host only)
+ *
+ * @param path Path of the book file
+ * @param entries Entries to write, sorted in place
+ * @param count Number of entries
+ * @return true on success, false otherwise.
+ */
+bool book_write(const char *path, BookEntry *entries, const uint64_t count);
+#endif
+
+#endif
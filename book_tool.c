@@ -0,0 +1,357 @@
+#include "book.h"
+#include "eval.h"
+#include "mcts.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Opening book tool (host build only)
+//   book_tool build BOOK [DEPTH] [ITERATIONS]
+//       Searches every position up to DEPTH plies (default 4) with MCTS
+//       (default 20000 iterations per position) and writes the book.
+//   book_tool carray BOOK OUT.c
+//       Writes the book as a C array for the firmware flash image.
+//   book_tool bench BOOK ENTRIES [LOOKUPS]
+//       Writes a synthetic book of ENTRIES entries and measures the lookup
+//       latency with a cold and a warm page cache.
+
+#define BOOK_TOOL_SEED 1 // Seed of the searches, a book is reproducible
+
+// Struct for storing a growable set of canonical keys and their entries
+// @field entries entries found so far
+// @field count number of entries
+// @field capacity capacity of entries
+// @field slots open addressing hash set of entry indices + 1, 0 is free
+// @field slot_count number of slots, a power of two
+typedef struct {
+  BookEntry *entries;
+  uint64_t count;
+  uint64_t capacity;
+  uint64_t *slots;
+  uint64_t slot_count;
+} BookSet;
+
+static MctsTree tree;
+
+// ----------------------------------------
+// Helpers
+// ----------------------------------------
+
+/*
+The function tool_ns reads the monotonic clock in nanoseconds.
+*/
+static uint64_t tool_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+The function tool_mix is the splitmix64 finalizer.
+*/
+static uint64_t tool_mix(uint64_t value) {
+  value += 0x9e3779b97f4a7c15ull;
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+  return value ^ (value >> 31);
+}
+
+/*
+The function set_insert adds a key to the set. It returns the new entry, or
+NULL if the key was already in the set.
+*/
+static BookEntry *set_insert(BookSet *set, const uint64_t key) {
+  // Grow the hash set at half load
+  if (set->count * 2 >= set->slot_count) {
+    uint64_t slot_count = set->slot_count ? set->slot_count * 2 : 1024;
+    uint64_t *slots = calloc(slot_count, sizeof(uint64_t));
+    for (uint64_t i = 0; i < set->count; i++) {
+      uint64_t s = tool_mix(set->entries[i].key) & (slot_count - 1);
+      while (slots[s] != 0) {
+        s = (s + 1) & (slot_count - 1);
+      }
+      slots[s] = i + 1;
+    }
+    free(set->slots);
+    set->slots = slots;
+    set->slot_count = slot_count;
+  }
+
+  // Look for the key
+  uint64_t s = tool_mix(key) & (set->slot_count - 1);
+  while (set->slots[s] != 0) {
+    if (set->entries[set->slots[s] - 1].key == key) {
+      return NULL;
+    }
+    s = (s + 1) & (set->slot_count - 1);
+  }
+
+  // Grow the entry array
+  if (set->count == set->capacity) {
+    set->capacity = set->capacity ? set->capacity * 2 : 1024;
+    set->entries = realloc(set->entries, set->capacity * sizeof(BookEntry));
+  }
+
+  BookEntry *entry = &set->entries[set->count++];
+  memset(entry, 0, sizeof(*entry));
+  entry->key = key;
+  set->slots[s] = set->count;
+  return entry;
+}
+
+// ----------------------------------------
+// build
+// ----------------------------------------
+
+/*
+The function tool_search searches one position and fills its entry. The move is
+stored in the canonical orientation and the score is the win rate of the best
+move scaled to -100..100.
+*/
+static void tool_search(BookEntry *entry, const Bitboard *bb, const char player,
+                        const uint sym, const uint32_t iterations) {
+  MctsBudget budget = {iterations, 0};
+  int move = mcts_search(&tree, bb, player, budget, BOOK_TOOL_SEED);
+
+  entry->move = book_map_cell(sym, move, true);
+  entry->depth = 0;
+  entry->score = 0;
+
+  // Score of the chosen child, in half points per visit
+  for (uint16_t child = tree.pool[0].first_child; child != MCTS_NONE;
+       child = tree.pool[child].next_sibling) {
+    if (tree.pool[child].move == move && tree.pool[child].visits > 0) {
+      entry->score =
+          (int8_t)(100 * tree.pool[child].score / tree.pool[child].visits -
+                   100);
+    }
+  }
+}
+
+/*
+The function tool_walk visits every position up to depth plies. Each canonical
+position is searched only once; positions where the game is over are skipped.
+*/
+static void tool_walk(BookSet *set, const Bitboard *bb, const char player,
+                      const uint depth, const uint32_t iterations) {
+  uint sym;
+  BookEntry *entry = set_insert(set, book_key(bb, &sym));
+
+  // Already visited through a symmetric or transposed position
+  if (entry == NULL) {
+    return;
+  }
+  tool_search(entry, bb, player, sym, iterations);
+  if (set->count % 1000 == 0) {
+    fprintf(stderr, "book_tool: %llu positions\n",
+            (unsigned long long)set->count);
+  }
+
+  if (depth == 0) {
+    return;
+  }
+
+  // Visit every child position that does not end the game
+  BbMask empty = bb_empty(bb);
+  while (empty != 0) {
+    uint cell = __builtin_ctzll(empty);
+    empty &= empty - 1;
+
+    Bitboard child = *bb;
+    bb_place(&child, player, cell);
+    if (bb_is_win_at(bb_pieces(&child, player), cell) ||
+        bb_empty(&child) == 0) {
+      continue;
+    }
+    tool_walk(set, &child, player == X ? O : X, depth - 1, iterations);
+  }
+}
+
+/*
+The function tool_build walks the positions from the empty board and writes
+the book.
+*/
+static int tool_build(const char *path, const uint depth,
+                      const uint32_t iterations) {
+  BookSet set = {0};
+  Bitboard empty = {0, 0};
+
+  tool_walk(&set, &empty, X, depth, iterations);
+  fprintf(stderr, "book_tool: writing %llu positions to %s\n",
+          (unsigned long long)set.count, path);
+
+  bool ok = book_write(path, set.entries, set.count);
+  free(set.entries);
+  free(set.slots);
+  return ok ? 0 : 1;
+}
+
+// ----------------------------------------
+// carray
+// ----------------------------------------
+
+/*
+The function tool_carray writes the book as a const array. On the RP2040 const
+data stays in flash and is read through XIP, so book_open_mem can be pointed at
+it directly.
+*/
+static int tool_carray(const char *path, const char *out_path) {
+  Book book;
+  if (!book_open_file(&book, path)) {
+    fprintf(stderr, "book_tool: %s is not a book for this board\n", path);
+    return 1;
+  }
+
+  FILE *out = fopen(out_path, "w");
+  if (out == NULL) {
+    book_close(&book);
+    return 1;
+  }
+
+  const uint8_t *data = (const uint8_t *)book.header;
+  fprintf(out, "// Generated by book_tool from %s\n", path);
+  fprintf(out, "#include <stddef.h>\n#include <stdint.h>\n\n");
+  fprintf(out, "const size_t book_data_size = %zu;\n", book.size);
+  fprintf(out, "const uint8_t book_data[] __attribute__((aligned(8))) = {");
+  for (size_t i = 0; i < book.size; i++) {
+    fprintf(out, "%s0x%02x,", i % 16 ? " " : "\n    ", data[i]);
+  }
+  fprintf(out, "\n};\n");
+
+  book_close(&book);
+  return fclose(out) == 0 ? 0 : 1;
+}
+
+// ----------------------------------------
+// bench
+// ----------------------------------------
+
+/*
+The function tool_bench_key returns the key of entry i of a synthetic book of
+count entries: one random key per slice of the key space, so the keys are
+sorted without sorting and can be recomputed for the lookups.
+*/
+static uint64_t tool_bench_key(const uint64_t i, const uint64_t count) {
+  uint64_t stride = UINT64_MAX / count;
+  return i * stride + tool_mix(i) % stride;
+}
+
+/*
+The function tool_compare_u64 orders latencies for qsort.
+*/
+static int tool_compare_u64(const void *a, const void *b) {
+  uint64_t ua = *(const uint64_t *)a;
+  uint64_t ub = *(const uint64_t *)b;
+  return ua < ub ? -1 : ua > ub;
+}
+
+/*
+The function tool_bench_lookups times lookups of random present keys one by
+one and prints the average, median and 99th percentile latency.
+*/
+static void tool_bench_lookups(const Book *book, const char *label,
+                               const uint64_t lookups, uint64_t *latency) {
+  uint64_t count = book->header->entry_count;
+  uint64_t total = 0;
+  uint64_t misses = 0;
+
+  for (uint64_t i = 0; i < lookups; i++) {
+    uint64_t key = tool_bench_key(tool_mix(i ^ 0x5bd1e995) % count, count);
+    uint64_t start = tool_ns();
+    misses += book_find(book, key) == NULL;
+    latency[i] = tool_ns() - start;
+    total += latency[i];
+  }
+
+  qsort(latency, lookups, sizeof(uint64_t), tool_compare_u64);
+  printf("%s: %llu lookups, avg %.0f ns, p50 %llu ns, p99 %llu ns, %llu "
+         "misses\n",
+         label, (unsigned long long)lookups, (double)total / lookups,
+         (unsigned long long)latency[lookups / 2],
+         (unsigned long long)latency[lookups * 99 / 100],
+         (unsigned long long)misses);
+}
+
+/*
+The function tool_bench writes a synthetic book, drops it from the page cache,
+maps it and runs the same random lookups twice: the first pass measures cold
+cache latency (page faults that read from disk), the second warm cache latency.
+*/
+static int tool_bench(const char *path, const uint64_t count,
+                      const uint64_t lookups) {
+  BookWriter writer;
+
+  // Write the synthetic book
+  uint64_t start = tool_ns();
+  if (count == 0 || !book_writer_open(&writer, path, count)) {
+    return 1;
+  }
+  for (uint64_t i = 0; i < count; i++) {
+    BookEntry entry = {.key = tool_bench_key(i, count),
+                       .move = i % BB_CELLS,
+                       .score = 0};
+    if (!book_writer_add(&writer, &entry)) {
+      book_writer_close(&writer);
+      return 1;
+    }
+  }
+  if (!book_writer_close(&writer)) {
+    return 1;
+  }
+  printf("write: %llu entries in %.2f s\n", (unsigned long long)count,
+         (tool_ns() - start) / 1e9);
+
+  // Drop the book from the page cache
+  int fd = open(path, O_RDONLY);
+  if (fd >= 0) {
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+
+  // Opening only maps the file
+  Book book;
+  start = tool_ns();
+  if (!book_open_file(&book, path)) {
+    return 1;
+  }
+  printf("open: %.0f us\n", (tool_ns() - start) / 1e3);
+
+  // First pass hits the disk, second pass the page cache
+  uint64_t *latency = malloc(lookups * sizeof(uint64_t));
+  tool_bench_lookups(&book, "cold", lookups, latency);
+  tool_bench_lookups(&book, "warm", lookups, latency);
+
+  free(latency);
+  book_close(&book);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  bb_init();
+  eval_init();
+  book_init();
+
+  if (argc >= 3 && strcmp(argv[1], "build") == 0) {
+    uint depth = argc > 3 ? (uint)strtoul(argv[3], NULL, 0) : 4;
+    uint32_t iterations = argc > 4 ? strtoul(argv[4], NULL, 0) : 20000;
+    return tool_build(argv[2], depth, iterations);
+  }
+  if (argc == 4 && strcmp(argv[1], "carray") == 0) {
+    return tool_carray(argv[2], argv[3]);
+  }
+  if (argc >= 4 && strcmp(argv[1], "bench") == 0) {
+    uint64_t lookups = argc > 4 ? strtoull(argv[4], NULL, 0) : 100000;
+    return tool_bench(argv[2], strtoull(argv[3], NULL, 0),
+                      lookups ? lookups : 1);
+  }
+
+  fprintf(stderr,
+          "usage: %s build BOOK [DEPTH] [ITERATIONS]\n"
+          "       %s carray BOOK OUT.c\n"
+          "       %s bench BOOK ENTRIES [LOOKUPS]\n",
+          argv[0], argv[0], argv[0]);
+  return 2;
+}
@@ -0,0 +1,326 @@
+#include "engine_async.h"
+#include "hardware/sync.h"
+#ifdef OPENING_BOOK
+#include "book.h"
+#endif
+
+// Struct for storing the mailbox shared by both cores. Each sequence number is
+// written by one core only; the data it guards is written before it with a
+// memory barrier in between.
+// @field request_seq last search posted, written by core0
+// @field cancel_seq last search cancelled, written by core0
+// @field taken_seq last search copied out of the mailbox, written by core1
+// @field done_seq last search finished or cancelled, written by core1
+// @field position position of the posted search, written by core0
+// @field max_us time budget of the posted search, written by core0
+// @field result result of the finished search, written by core1
+// @field done_us time core1 published the result, written by core1
+typedef struct {
+  volatile uint32_t request_seq;
+  volatile uint32_t cancel_seq;
+  volatile uint32_t taken_seq;
+  volatile uint32_t done_seq;
+  EnginePosition position;
+  uint32_t max_us;
+  EngineResult result;
+  uint64_t done_us;
+} EngineMailbox;
+
+static EngineMailbox mailbox;
+
+// Core0 state: last result collected, time of the last input loop and of the
+// cancel
+static uint32_t collected_seq = 0;
+static uint64_t last_loop_us = 0;
+static uint64_t cancel_us = 0;
+// Instrumentation counters, written by core0 only
+static EngineAsyncStats stats;
+
+// Core1 state: the search in progress and its copy of the request
+static bool job_active = false;
+static uint32_t job_seq = 0;
+static uint32_t job_max_us = 0;
+#ifdef ULTIMATE
+static UltTree tree;
+#else
+static MctsTree tree;
+// Move of the search in progress known without searching, forced or found in
+// the opening book, -1 if none
+static int job_known_move = -1;
+#endif
+
+#if defined(OPENING_BOOK) && !defined(ULTIMATE)
+// Opening book linked into flash, read by core1 before every search
+static Book book;
+static bool book_ready = false;
+#endif
+
+// ----------------------------------------
+// Internal helpers
+// ----------------------------------------
+
+/*
+The functions engine_start, engine_run, engine_is_over and engine_best_move
+adapt the search of the game variant being built to the service. In the
+classic game a forced move (mcts_forced_move), as in mcts_search, or a position
+found in the opening book is over at once with that move, no iteration is run.
+*/
+static void engine_start(const EnginePosition *position, const uint32_t seed) {
+#ifdef ULTIMATE
+  ult_search_init(&tree, position, seed);
+#else
+  mcts_init(&tree, &position->board, position->to_move, seed);
+  job_known_move = mcts_forced_move(&tree);
+#ifdef OPENING_BOOK
+  if (job_known_move < 0 && book_ready) {
+    book_lookup(&book, &position->board, &job_known_move, NULL);
+  }
+#endif
+#endif
+}
+
+static void engine_run(const uint32_t iterations) {
+#ifdef ULTIMATE
+  ult_run(&tree, iterations);
+#else
+  mcts_run(&tree, iterations);
+#endif
+}
+
+static bool engine_is_over(void) {
+#ifdef ULTIMATE
+  return tree.pool[0].winner != 0;
+#else
+  return tree.pool[0].winner != 0 || job_known_move >= 0;
+#endif
+}
+
+static int engine_best_move(void) {
+#ifdef ULTIMATE
+  return ult_best_move(&tree);
+#else
+  return job_known_move >= 0 ? job_known_move : mcts_best_move(&tree);
+#endif
+}
+
+/*
+The function engine_finish publishes the result of the search in progress and
+wakes core0 up in case it waits in WFE. The time is stamped on core1, so core0
+measures the cancel latency up to the acknowledge and not up to its own poll.
+*/
+static void engine_finish(const bool cancelled) {
+  mailbox.result.seq = job_seq;
+  mailbox.result.move = cancelled ? -1 : engine_best_move();
+  mailbox.result.iterations = tree.iterations;
+  mailbox.result.elapsed_us = tree.elapsed_us;
+  mailbox.done_us = time_us_64();
+
+  // The result must be visible before done_seq
+  __dmb();
+  mailbox.done_seq = job_seq;
+  __sev();
+  job_active = false;
+}
+
+// ----------------------------------------
+// Core0 functions
+// ----------------------------------------
+
+/*
+The function engine_async_init empties the mailbox and the counters, and opens
+the opening book when one is linked in.
+*/
+void engine_async_init(void) {
+  mailbox.request_seq = 0;
+  mailbox.cancel_seq = 0;
+  mailbox.taken_seq = 0;
+  mailbox.done_seq = 0;
+  collected_seq = 0;
+  stats = (EngineAsyncStats){0};
+#if defined(OPENING_BOOK) && !defined(ULTIMATE)
+  // The book is read in place, a book built for another board is ignored
+  book_init();
+  book_ready = book_open_mem(&book, book_data, book_data_size);
+#endif
+}
+
+/*
+The function engine_async_post copies the position into the mailbox and
+publishes it by bumping request_seq. Core1 only reads the position after it
+sees the new sequence number, and a new search is only posted once the last
+one was collected, so the copy can never tear.
+*/
+uint32_t engine_async_post(const EnginePosition *position,
+                           const uint32_t max_us) {
+  if (engine_async_busy()) {
+    return 0;
+  }
+
+  // Fill in the request
+  uint32_t seq = mailbox.request_seq + 1;
+  mailbox.position = *position;
+  mailbox.max_us = max_us;
+
+  // The request must be visible before request_seq, then wake core1 up
+  __dmb();
+  mailbox.request_seq = seq;
+  __sev();
+
+  stats.posted++;
+  last_loop_us = time_us_64();
+  return seq;
+}
+
+/*
+The function engine_async_busy checks if the last posted search was collected.
+*/
+bool engine_async_busy(void) {
+  return collected_seq != mailbox.request_seq;
+}
+
+/*
+The function engine_async_note_loop measures the time since its last call while
+a search runs. It is called by the task sampling the buttons, so the gap is the
+worst case delay before a button press is seen.
+*/
+void engine_async_note_loop(void) {
+  if (!engine_async_busy()) {
+    return;
+  }
+
+  // Measure the core0 loop gap
+  uint64_t now = time_us_64();
+  uint64_t gap = now - last_loop_us;
+  last_loop_us = now;
+  stats.poll_gap_samples++;
+  stats.poll_gap_total_us += gap;
+  if (gap > stats.poll_gap_max_us) {
+    stats.poll_gap_max_us = gap;
+  }
+}
+
+/*
+The function engine_async_poll copies the result out of the mailbox once core1
+has finished.
+*/
+bool engine_async_poll(EngineResult *result) {
+  if (!engine_async_busy()) {
+    return false;
+  }
+
+  // Check if core1 has finished
+  uint32_t seq = mailbox.done_seq;
+  if (seq != mailbox.request_seq) {
+    return false;
+  }
+  __dmb();
+  collected_seq = seq;
+  stats.search_us += mailbox.result.elapsed_us;
+
+  // Drop cancelled searches. A search that finished before the cancel was
+  // made has nothing to acknowledge.
+  if (mailbox.cancel_seq == seq) {
+    stats.cancelled++;
+    uint64_t latency = mailbox.done_us > cancel_us ? mailbox.done_us - cancel_us
+                                                   : 0;
+    if (latency > stats.cancel_latency_max_us) {
+      stats.cancel_latency_max_us = latency;
+    }
+    return false;
+  }
+
+  *result = mailbox.result;
+  stats.completed++;
+  return true;
+}
+
+/*
+The function engine_async_cancel marks the posted search as cancelled. Core1
+checks the mark between slices and finishes the search without a move.
+*/
+void engine_async_cancel(void) {
+  if (!engine_async_busy() || mailbox.cancel_seq == mailbox.request_seq) {
+    return;
+  }
+  cancel_us = time_us_64();
+  mailbox.cancel_seq = mailbox.request_seq;
+  __sev();
+}
+
+/*
+The function engine_async_get_stats returns a copy of the counters.
+*/
+EngineAsyncStats engine_async_get_stats(void) { return stats; }
+
+/*
+The function engine_async_print_stats prints the search counts, the average
+and worst core0 loop gap during searches and the worst cancel latency.
+*/
+void engine_async_print_stats(void) {
+  EngineAsyncStats s = stats;
+  printf("Engine: %lu posted, %lu completed, %lu cancelled, %llu ms search\n",
+         (unsigned long)s.posted, (unsigned long)s.completed,
+         (unsigned long)s.cancelled, (unsigned long long)s.search_us / 1000);
+  if (s.poll_gap_samples > 0) {
+    printf("Engine: core0 loop gap avg %llu us, max %llu us, cancel max %llu "
+           "us\n",
+           (unsigned long long)(s.poll_gap_total_us / s.poll_gap_samples),
+           (unsigned long long)s.poll_gap_max_us,
+           (unsigned long long)s.cancel_latency_max_us);
+  }
+}
+
+// ----------------------------------------
+// Core1 functions
+// ----------------------------------------
+
+/*
+The function engine_async_step takes a new request out of the mailbox when
+there is one, then runs one slice of the search. The search ends when it is
+cancelled, when the time budget is spent or when the position is already over.
+*/
+bool engine_async_step(void) {
+  // Take a new request
+  if (!job_active) {
+    uint32_t seq = mailbox.request_seq;
+    if (seq == mailbox.taken_seq) {
+      return false;
+    }
+    __dmb();
+    job_seq = seq;
+    job_max_us = mailbox.max_us;
+    engine_start(&mailbox.position, (uint32_t)time_us_64());
+    mailbox.taken_seq = seq;
+    job_active = true;
+  }
+
+  // Stop right away when cancelled
+  if (mailbox.cancel_seq == job_seq) {
+    engine_finish(true);
+    return true;
+  }
+
+  // Run one slice and stop when the budget is spent
+  if (!engine_is_over()) {
+    engine_run(MCTS_CHECK_INTERVAL);
+  }
+  if (engine_is_over() || tree.elapsed_us >= job_max_us) {
+    engine_finish(false);
+  }
+  return true;
+}
+
+/*
+The function engine_async_sleep_ms runs search slices until the time is up.
+Without a search, core1 waits in WFE until the deadline or until core0 posts a
+search, so a new search starts right away and not after the blink.
+*/
+void engine_async_sleep_ms(const uint32_t ms) {
+  uint64_t until_us = time_us_64() + (uint64_t)ms * 1000;
+
+  while (time_us_64() < until_us) {
+    if (!engine_async_step()) {
+      best_effort_wfe_or_timeout(from_us_since_boot(until_us));
+    }
+  }
+}
@@ -0,0 +1,157 @@
+#ifndef __ENGINE_ASYNC_H__
+#define __ENGINE_ASYNC_H__
+
+#include "game.h"
+#include "mcts.h"
+#ifdef ULTIMATE
+#include "ultimate.h"
+#endif
+#include <stdint.h>
+
+// Engine compute service on core1
+// Core0 posts a snapshot of the position and a time budget, then keeps polling
+// the buttons; core1 searches in slices of MCTS_CHECK_INTERVAL iterations
+// between blinks of the winner LED and hands the move back through a
+// completion mailbox. A cancel is seen by core1 after at most one slice.
+// In the classic game a forced move (mcts_forced_move) and a position found in
+// the opening book (OPENING_BOOK) are answered without searching.
+// On the host core1 code does not run, so posted searches never complete
+// unless a thread calls engine_async_step, as engine_check does.
+
+#ifdef ULTIMATE
+// Position searched by the engine
+typedef UltBoard EnginePosition;
+#else
+#ifndef ENGINE_PLAYER
+#define ENGINE_PLAYER 0               // Player moved by the engine, 0 for none
+#endif
+#ifndef ENGINE_US
+#define ENGINE_US 1000000             // Engine thinking time in microseconds
+#endif
+
+// Struct for storing the position searched by the engine
+// @field board the pieces of both players
+// @field to_move the player to move
+typedef struct {
+  Bitboard board;
+  char to_move;
+} EnginePosition;
+#endif
+
+// Struct for storing the result of one search
+// @field seq sequence number returned by engine_async_post
+// @field move best move as a cell index, -1 if there is none
+// @field iterations number of iterations run
+// @field elapsed_us time core1 spent searching
+typedef struct {
+  uint32_t seq;
+  int move;
+  uint32_t iterations;
+  uint64_t elapsed_us;
+} EngineResult;
+
+// Struct for storing engine service instrumentation
+// @field posted number of searches posted by core0
+// @field completed number of searches that returned a move
+// @field cancelled number of searches stopped by engine_async_cancel
+// @field search_us accumulated time core1 spent searching
+// @field poll_gap_samples number of core0 loop gaps measured during searches
+// @field poll_gap_total_us sum of the core0 loop gaps during searches
+// @field poll_gap_max_us worst core0 loop gap during a search, the longest a
+// button press could go unnoticed
+// @field cancel_latency_max_us worst time from a cancel to the acknowledge by
+// core1, stamped by core1
+typedef struct {
+  uint32_t posted;
+  uint32_t completed;
+  uint32_t cancelled;
+  uint64_t search_us;
+  uint32_t poll_gap_samples;
+  uint64_t poll_gap_total_us;
+  uint64_t poll_gap_max_us;
+  uint64_t cancel_latency_max_us;
+} EngineAsyncStats;
+
+// ----------------------------------------
+// Core0 functions
+// ----------------------------------------
+
+/**
+ * @brief Empties the mailbox, resets the instrumentation and opens the linked
+ * opening book; must be called after bb_init and before core1 is launched
+ */
+void engine_async_init(void);
+
+/**
+ * @brief Posts a position to search on core1
+ *
+ * @param position The position, copied into the mailbox
+ * @param max_us Time budget of the search in microseconds
+ * @return The sequence number of the search, or 0 if a search is still
+ * running.
+ */
+uint32_t engine_async_post(const EnginePosition *position,
+                           const uint32_t max_us);
+
+/**
+ * @brief Returns whether a posted search has not been collected yet
+ *
+ * @return true If a search is running or its result is waiting
+ * @return false If a new search can be posted
+ */
+bool engine_async_busy(void);
+
+/**
+ * @brief Measures the core0 loop gap while a search runs, called by the task
+ * sampling the buttons
+ */
+void engine_async_note_loop(void);
+
+/**
+ * @brief Collects the result of the posted search, called from the core0 loop
+ *
+ * @param result Receives the result
+ * @return true If a search finished with a move; cancelled searches are
+ * collected silently and return false
+ */
+bool engine_async_poll(EngineResult *result);
+
+/**
+ * @brief Cancels the posted search, its result is dropped
+ */
+void engine_async_cancel(void);
+
+/**
+ * @brief Returns the engine service instrumentation
+ *
+ * @return A copy of the counters
+ */
+EngineAsyncStats engine_async_get_stats(void);
+
+/**
+ * @brief Prints the search counts and how responsive core0 stayed
+ */
+void engine_async_print_stats(void);
+
+// ----------------------------------------
+// Core1 functions
+// ----------------------------------------
+
+/**
+ * @brief Runs one slice of the posted search, if any
+ *
+ * @return true If a search is running, false if core1 has nothing to do
+ */
+bool engine_async_step(void);
+
+/**
+ * @brief Waits a number of milliseconds on core1, searching meanwhile
+ *
+ * Used by flash_winner_led instead of sleep_ms. When no search is posted
+ * core1 waits in WFE, which a post wakes up.
+ *
+ * @param ms Time to wait in milliseconds
+ */
+void engine_async_sleep_ms(const uint32_t ms);
+
+#endif
@@ -0,0 +1,309 @@
+#include "bitboard.h"
+#include "engine_async.h"
+#include "eval.h"
+#include "game.h"
+#include "mcts.h"
+#include "ultimate.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Host checks of the engines (host build only)
+//   engine_check [positions] [seed]
+// - the fixed-point UCT terms against the same formula in double precision,
+// - mcts_search on random positions returns an empty cell, a winning cell
+//   whenever the player to move can win at once, and otherwise the cell of the
+//   opponent's only threat,
+// - ult_search on random positions returns a legal move,
+// - the engine mailbox, with a thread standing in for core1, returns legal
+//   moves, drops cancelled searches and records the loop gap and the cancel
+//   latency.
+// Prints one line per check and exits with status 1 on the first failure.
+
+#define CHECK_ITERATIONS 256       // Iterations of every search
+#define CHECK_LOG_TOL 0.07         // Worst error of the interpolated ln(N)
+#define CHECK_UCT_TOL 0.03         // Relative error of the exploration term
+#define CHECK_ASYNC_US 2000        // Time budget of every posted search
+#define CHECK_ASYNC_WAIT 1000000   // Longest wait for a posted search
+#define CHECK_CANCEL_US 100000     // Worst accepted cancel latency
+#define Q16 65536.0
+
+// Search trees, too large for the stack
+static MctsTree tree;
+static UltTree ult_tree;
+// State of the xorshift generator
+static uint32_t rng = 1;
+// Set to stop the thread standing in for core1
+static volatile bool core1_stop = false;
+
+// ----------------------------------------
+// Helpers
+// ----------------------------------------
+
+/*
+The function check_rand returns the next value of the xorshift generator.
+*/
+static uint32_t check_rand(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+/*
+The function check_fail reports a failed check and exits.
+*/
+static void check_fail(const char *what, const uint32_t position) {
+  fprintf(stderr, "engine_check: %s (position %lu)\n", what,
+          (unsigned long)position);
+  exit(1);
+}
+
+/*
+The function check_random_cell returns a random cell of a non-empty mask.
+*/
+static uint check_random_cell(BbMask mask) {
+  for (uint skip = check_rand() % __builtin_popcountll(mask); skip > 0;
+       skip--) {
+    mask &= mask - 1;
+  }
+  return __builtin_ctzll(mask);
+}
+
+// ----------------------------------------
+// Checks
+// ----------------------------------------
+
+/*
+The function check_uct compares mcts_uct_log and mcts_uct_value with the
+formula they approximate, ln(N) and score / visits + C * sqrt(ln(N) /
+visits), over parent counts from 0 to 2^24 and random child counts.
+*/
+static void check_uct(void) {
+  double log_err = 0;
+  double uct_err = 0;
+
+  // An unvisited parent has no exploration term
+  if (mcts_uct_log(0) != 0) {
+    check_fail("mcts_uct_log(0) is not 0", 0);
+  }
+
+  for (uint32_t n = 1; n < (1u << 24); n += 1 + n / 8) {
+    // ln(N), the result is in Q16.16 shifted left by 10
+    uint32_t log_n = mcts_uct_log(n);
+    double err = fabs(log_n / Q16 / 1024.0 - log((double)n));
+    if (err > log_err) {
+      log_err = err;
+    }
+    if (err > CHECK_LOG_TOL) {
+      check_fail("mcts_uct_log is off", n);
+    }
+
+    // A few children of this parent
+    for (int i = 0; i < 8; i++) {
+      uint32_t visits = 1 + check_rand() % n;
+      uint32_t score = check_rand() % (2 * visits + 1);
+      double exploit = score / 2.0 / visits;
+      double explore = MCTS_UCT_C_Q16 / Q16 * sqrt(log(n) / visits);
+      double value = mcts_uct_value(score, visits, log_n) / Q16;
+      double tol = 1.0 / 4096 + CHECK_UCT_TOL * explore;
+      if (fabs(value - (exploit + explore)) > tol) {
+        check_fail("mcts_uct_value is off", n);
+      }
+      if (fabs(value - (exploit + explore)) > uct_err) {
+        uct_err = fabs(value - (exploit + explore));
+      }
+    }
+  }
+  printf("engine_check: uct ok, ln error %.4f, value error %.4f\n", log_err,
+         uct_err);
+}
+
+/*
+The function check_mcts searches random positions that are not over. The move
+must be an empty cell, and one of the winning cells when the player to move
+has a threat. Otherwise, if the opponent threatens a single cell, the move must
+block it.
+*/
+static void check_mcts(const uint32_t positions) {
+  uint32_t wins = 0;
+  uint32_t blocks = 0;
+
+  for (uint32_t p = 0; p < positions; p++) {
+    // Play random moves, keep the last position that is not over
+    Bitboard bb = {0, 0};
+    char to_move = X;
+    uint plies = check_rand() % BB_CELLS;
+    for (uint i = 0; i < plies; i++) {
+      Bitboard next = bb;
+      uint cell = check_random_cell(bb_empty(&bb));
+      bb_place(&next, to_move, cell);
+      if (bb_is_win_at(bb_pieces(&next, to_move), cell) ||
+          bb_empty(&next) == 0) {
+        break;
+      }
+      bb = next;
+      to_move = to_move == X ? O : X;
+    }
+
+    // The cells that win at once, for both players
+    EvalState state;
+    eval_from_board(&state, &bb);
+    BbMask threats = eval_threat_cells(&state, to_move);
+    BbMask losses = eval_threat_cells(&state, to_move == X ? O : X);
+
+    MctsBudget budget = {.max_iterations = CHECK_ITERATIONS, .max_us = 0};
+    int move = mcts_search(&tree, &bb, to_move, budget, check_rand());
+    if (move < 0 || move >= BB_CELLS || ((bb_empty(&bb) >> move) & 1) == 0) {
+      check_fail("mcts_search returned an illegal move", p);
+    }
+    if (threats != 0) {
+      if (((threats >> move) & 1) == 0) {
+        check_fail("mcts_search missed a win", p);
+      }
+      wins++;
+    } else if (losses != 0 && (losses & (losses - 1)) == 0) {
+      if (((losses >> move) & 1) == 0) {
+        check_fail("mcts_search missed a block", p);
+      }
+      blocks++;
+    }
+  }
+  printf("engine_check: mcts ok, %lu positions, %lu with a win, %lu with a "
+         "block\n",
+         (unsigned long)positions, (unsigned long)wins, (unsigned long)blocks);
+}
+
+/*
+The function check_ult searches random ultimate positions that are not over.
+The move must be legal.
+*/
+static void check_ult(const uint32_t positions) {
+  for (uint32_t p = 0; p < positions; p++) {
+    // Play random legal moves until the game is over or enough are played
+    UltBoard board;
+    ult_clear(&board);
+    uint plies = check_rand() % 40;
+    for (uint i = 0; i < plies; i++) {
+      uint cell;
+      do {
+        cell = check_rand() % ULT_CELLS;
+      } while (!ult_is_legal(&board, cell));
+      UltBoard next = board;
+      ult_play(&next, cell);
+      if (next.winner != 0) {
+        break;
+      }
+      board = next;
+    }
+
+    MctsBudget budget = {.max_iterations = CHECK_ITERATIONS, .max_us = 0};
+    int move = ult_search(&ult_tree, &board, budget, check_rand());
+    if (move < 0 || !ult_is_legal(&board, move)) {
+      check_fail("ult_search returned an illegal move", p);
+    }
+  }
+  printf("engine_check: ultimate ok, %lu positions\n",
+         (unsigned long)positions);
+}
+
+/*
+The function check_core1 serves the engine mailbox the way core1 does between
+blinks of the winner LED.
+*/
+static void *check_core1(void *arg) {
+  (void)arg;
+  while (!core1_stop) {
+    engine_async_sleep_ms(1);
+  }
+  return NULL;
+}
+
+/*
+The function check_async posts searches of the empty board to a thread running
+the core1 side of the service, and cancels every other one shortly after the
+post. Core0 polls like the main loop does. A finished search must return an
+empty cell, a cancelled one must not return at all, and the counters must add
+up.
+*/
+static void check_async(const uint32_t searches) {
+  pthread_t core1;
+  engine_async_init();
+  core1_stop = false;
+  if (pthread_create(&core1, NULL, check_core1, NULL) != 0) {
+    check_fail("cannot start the core1 thread", 0);
+  }
+
+  for (uint32_t s = 0; s < searches; s++) {
+#ifdef ULTIMATE
+    EnginePosition position;
+    ult_clear(&position);
+#else
+    EnginePosition position = {.board = {0, 0}, .to_move = X};
+#endif
+    if (engine_async_post(&position, CHECK_ASYNC_US) == 0) {
+      check_fail("engine_async_post refused a search", s);
+    }
+
+    // Poll until the search is collected
+    uint64_t start = time_us_64();
+    EngineResult result;
+    while (engine_async_busy()) {
+      engine_async_note_loop();
+      if (s % 2 == 1 && time_us_64() - start > CHECK_ASYNC_US / 4) {
+        engine_async_cancel();
+      }
+      if (engine_async_poll(&result)) {
+#ifdef ULTIMATE
+        bool legal = result.move >= 0 && ult_is_legal(&position, result.move);
+#else
+        bool legal = result.move >= 0 && result.move < BB_CELLS;
+#endif
+        if (!legal) {
+          check_fail("engine_async_poll returned an illegal move", s);
+        }
+      }
+      if (time_us_64() - start > CHECK_ASYNC_WAIT) {
+        check_fail("posted search never finished", s);
+      }
+      usleep(100);
+    }
+  }
+
+  core1_stop = true;
+  pthread_join(core1, NULL);
+
+  EngineAsyncStats stats = engine_async_get_stats();
+  if (stats.posted != searches ||
+      stats.completed + stats.cancelled != searches || stats.cancelled == 0) {
+    check_fail("engine_async counters do not add up", stats.posted);
+  }
+  if (stats.poll_gap_samples == 0 ||
+      stats.cancel_latency_max_us > CHECK_CANCEL_US) {
+    check_fail("engine_async timing is off",
+               (uint32_t)stats.cancel_latency_max_us);
+  }
+  printf("engine_check: async ok, %lu completed, %lu cancelled, loop gap max "
+         "%llu us, cancel max %llu us\n",
+         (unsigned long)stats.completed, (unsigned long)stats.cancelled,
+         (unsigned long long)stats.poll_gap_max_us,
+         (unsigned long long)stats.cancel_latency_max_us);
+}
+
+int main(int argc, char **argv) {
+  uint32_t positions = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : 2000;
+  uint32_t seed = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 1;
+  rng = seed ? seed : 1;
+
+  // Build the tables used by the engines
+  bb_init();
+  eval_init();
+  ult_init();
+
+  check_uct();
+  check_mcts(positions);
+  check_ult(positions / 8);
+  check_async(positions / 50);
+  return 0;
+}
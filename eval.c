@@ -0,0 +1,388 @@
+#include "eval.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define EVAL_X86 1
+#include <immintrin.h>
+#else
+#define EVAL_X86 0
+#endif
+
+// Window counts are table indices, one step per piece of each player
+#define EVAL_STEP_X (WIN_LENGTH + 1)
+#define EVAL_STEP_O 1
+
+// Threat flags of a window by table index
+#define EVAL_THREAT_X 1
+#define EVAL_THREAT_O 2
+
+int16_t eval_lut[WIN_LENGTH + 1][WIN_LENGTH + 1];
+int32_t eval_line_score[EVAL_LUT_SIZE];
+
+// Threat flags of a window by x * EVAL_STEP_X + o, filled by eval_init
+static uint8_t eval_line_flags[EVAL_LUT_SIZE];
+
+// Instruction sets eval_rescan can use
+typedef enum { EVAL_ISA_UNKNOWN, EVAL_ISA_SCALAR, EVAL_ISA_AVX2 } EvalIsa;
+
+// Instruction set picked on the first call
+static EvalIsa eval_isa_used = EVAL_ISA_UNKNOWN;
+
+// ----------------------------------------
+// Vector helpers
+// ----------------------------------------
+
+#if EVAL_X86
+// Windows rounded up to whole registers of four 64 bit lanes, the extra
+// windows are empty and score eval_line_score[0] = 0
+#define EVAL_AVX_LINES ((BB_LINE_COUNT + 3) & ~3)
+static BbMask avx_lines[EVAL_AVX_LINES] __attribute__((aligned(32)));
+
+/*
+The function eval_popcount_avx2 counts the set bits of every 64 bit lane: the
+bits of every nibble are looked up with a byte shuffle, then the bytes of every
+lane are summed with a sum of absolute differences against zero.
+*/
+__attribute__((target("avx2"))) static inline __m256i
+eval_popcount_avx2(const __m256i v) {
+  const __m256i nibble_bits =
+      _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1,
+                       2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low = _mm256_set1_epi8(0x0F);
+  __m256i lo = _mm256_and_si256(v, low);
+  __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+  __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(nibble_bits, lo),
+                                  _mm256_shuffle_epi8(nibble_bits, hi));
+  return _mm256_sad_epu8(bytes, _mm256_setzero_si256());
+}
+
+/*
+The function eval_rescan_avx2 handles four windows per step: both masks are
+ANDed with the windows, the pieces are counted per lane, and the table index
+x * EVAL_STEP_X + o of every window gathers its score.
+*/
+__attribute__((target("avx2"))) static int32_t
+eval_rescan_avx2(const Bitboard *bb, uint8_t *count_x, uint8_t *count_o) {
+  const __m256i vx = _mm256_set1_epi64x((long long)bb->x);
+  const __m256i vo = _mm256_set1_epi64x((long long)bb->o);
+  const __m256i step = _mm256_set1_epi64x(EVAL_STEP_X);
+  __m128i sum = _mm_setzero_si128();
+
+  for (uint l = 0; l < EVAL_AVX_LINES; l += 4) {
+    __m256i lines = _mm256_load_si256((const __m256i *)&avx_lines[l]);
+    __m256i nx = eval_popcount_avx2(_mm256_and_si256(vx, lines));
+    __m256i no = eval_popcount_avx2(_mm256_and_si256(vo, lines));
+
+    // Gather the scores of the four windows
+    __m256i index = _mm256_add_epi64(_mm256_mul_epu32(nx, step), no);
+    sum = _mm_add_epi32(
+        sum, _mm256_i64gather_epi32((const int *)eval_line_score, index, 4));
+
+    // Store the counts of the windows that exist
+    if (count_x != NULL || count_o != NULL) {
+      uint64_t cx[4];
+      uint64_t co[4];
+      _mm256_storeu_si256((__m256i *)cx, nx);
+      _mm256_storeu_si256((__m256i *)co, no);
+      for (uint k = 0; k < 4 && l + k < BB_LINE_COUNT; k++) {
+        if (count_x != NULL) {
+          count_x[l + k] = (uint8_t)cx[k];
+        }
+        if (count_o != NULL) {
+          count_o[l + k] = (uint8_t)co[k];
+        }
+      }
+    }
+  }
+
+  // Add up the four lanes
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum);
+}
+#endif
+
+// Struct for storing the threat changes of one move until the windows are done
+// @field flip_x windows whose X threat changes
+// @field flip_o windows whose O threat changes
+// @field count_x change of the number of X threats
+// @field count_o change of the number of O threats
+typedef struct {
+  uint32_t flip_x[EVAL_LINE_WORDS];
+  uint32_t flip_o[EVAL_LINE_WORDS];
+  int count_x;
+  int count_o;
+} EvalThreatDelta;
+
+/*
+The function eval_threat_flip adds the threat changes of a window moving from
+one table index to another. It has no branches: which moves change a threat is
+not predictable.
+*/
+static inline void eval_threat_flip(EvalThreatDelta *delta, const uint l,
+                                    const uint before, const uint after) {
+  uint from = eval_line_flags[before];
+  uint to = eval_line_flags[after];
+  uint changed = from ^ to;
+  uint32_t bit = 1u << (l & 31);
+  delta->flip_x[l >> 5] ^= bit & -(uint32_t)(changed & EVAL_THREAT_X);
+  delta->flip_o[l >> 5] ^= bit & -(uint32_t)(changed >> 1);
+  delta->count_x += (int)(to & EVAL_THREAT_X) - (int)(from & EVAL_THREAT_X);
+  delta->count_o += (int)(to >> 1) - (int)(from >> 1);
+}
+
+/*
+The function eval_threat_apply applies the collected changes to the state.
+*/
+static inline void eval_threat_apply(EvalState *state,
+                                     const EvalThreatDelta *delta) {
+  for (uint w = 0; w < EVAL_LINE_WORDS; w++) {
+    state->threats_x[w] ^= delta->flip_x[w];
+    state->threats_o[w] ^= delta->flip_o[w];
+  }
+  state->threat_count_x += delta->count_x;
+  state->threat_count_o += delta->count_o;
+}
+
+/*
+The function eval_detect picks AVX2 if the CPU supports it.
+*/
+static void eval_detect(void) {
+  eval_isa_used = EVAL_ISA_SCALAR;
+#if EVAL_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    eval_isa_used = EVAL_ISA_AVX2;
+  }
+#endif
+}
+
+// ----------------------------------------
+// Evaluation functions
+// ----------------------------------------
+
+/*
+The function eval_init fills the default table. The weight grows by 8 per
+piece, so one window with one more piece outweighs most windows with one less.
+A full window is a win and eval_score returns EVAL_WIN for it anyway. The
+threat flags do not depend on the table: a window is a threat for a player
+with WIN_LENGTH - 1 pieces of the player and none of the opponent.
+*/
+void eval_init(void) {
+  int16_t lut[WIN_LENGTH + 1][WIN_LENGTH + 1];
+  memset(lut, 0, sizeof(lut));
+  for (uint k = 1; k <= WIN_LENGTH; k++) {
+    uint shift = 3 * (k - 1) < 14 ? 3 * (k - 1) : 14;
+    lut[k][0] = k == WIN_LENGTH ? INT16_MAX : (int16_t)(1 << shift);
+  }
+  eval_set_lut((const int16_t(*)[WIN_LENGTH + 1])lut);
+
+  memset(eval_line_flags, 0, sizeof(eval_line_flags));
+  eval_line_flags[(WIN_LENGTH - 1) * EVAL_STEP_X] = EVAL_THREAT_X;
+  eval_line_flags[(WIN_LENGTH - 1) * EVAL_STEP_O] = EVAL_THREAT_O;
+
+#if EVAL_X86
+  memset(avx_lines, 0, sizeof(avx_lines));
+  memcpy(avx_lines, bb_lines, sizeof(bb_lines));
+#endif
+}
+
+/*
+The function eval_set_lut copies the table and derives the score of every
+(x, o) window for X, so eval_place needs one lookup per window.
+*/
+void eval_set_lut(const int16_t lut[WIN_LENGTH + 1][WIN_LENGTH + 1]) {
+  memcpy(eval_lut, lut, sizeof(eval_lut));
+  for (uint x = 0; x <= WIN_LENGTH; x++) {
+    for (uint o = 0; o <= WIN_LENGTH; o++) {
+      eval_line_score[x * EVAL_STEP_X + o * EVAL_STEP_O] =
+          (int32_t)eval_lut[x][o] - eval_lut[o][x];
+    }
+  }
+}
+
+/*
+The function eval_clear empties the position; an empty window scores
+eval_line_score[0], which is 0 for any table.
+*/
+void eval_clear(EvalState *state) {
+  memset(state, 0, sizeof(*state));
+}
+
+/*
+The function eval_from_board rescans the position, then counts the full
+windows and collects the threats from the window counts.
+*/
+void eval_from_board(EvalState *state, const Bitboard *bb) {
+  memset(state, 0, sizeof(*state));
+  state->bb = *bb;
+  state->score = eval_rescan(bb, state->count_x, state->count_o);
+  state->filled = __builtin_popcountll(bb->x | bb->o);
+  EvalThreatDelta delta = {0};
+  for (uint l = 0; l < BB_LINE_COUNT; l++) {
+    state->wins_x += state->count_x[l] == WIN_LENGTH;
+    state->wins_o += state->count_o[l] == WIN_LENGTH;
+    eval_threat_flip(&delta, l, 0,
+                     state->count_x[l] * EVAL_STEP_X + state->count_o[l]);
+  }
+  eval_threat_apply(state, &delta);
+}
+
+/*
+The function eval_place adds the piece to the counts of every window through
+the cell. Each window moves one step in the table, the score changes by the
+difference of the two entries and the threats by the difference of their
+flags.
+*/
+void eval_place(EvalState *state, const char player, const uint cell) {
+  uint8_t *own = player == X ? state->count_x : state->count_o;
+  uint16_t *wins = player == X ? &state->wins_x : &state->wins_o;
+  uint step = player == X ? EVAL_STEP_X : EVAL_STEP_O;
+  int32_t score = state->score;
+  EvalThreatDelta delta = {0};
+
+  bb_place(&state->bb, player, cell);
+  for (uint i = 0; i < bb_cell_line_count[cell]; i++) {
+    uint l = bb_cell_lines[cell][i];
+    uint before = state->count_x[l] * EVAL_STEP_X + state->count_o[l];
+    score += eval_line_score[before + step] - eval_line_score[before];
+    eval_threat_flip(&delta, l, before, before + step);
+    if (++own[l] == WIN_LENGTH) {
+      (*wins)++;
+    }
+  }
+  state->score = score;
+  state->filled++;
+  eval_threat_apply(state, &delta);
+}
+
+/*
+The function eval_remove is eval_place backwards.
+*/
+void eval_remove(EvalState *state, const char player, const uint cell) {
+  uint8_t *own = player == X ? state->count_x : state->count_o;
+  uint16_t *wins = player == X ? &state->wins_x : &state->wins_o;
+  uint step = player == X ? EVAL_STEP_X : EVAL_STEP_O;
+  int32_t score = state->score;
+  EvalThreatDelta delta = {0};
+
+  if (player == X) {
+    state->bb.x &= ~(1ull << cell);
+  } else {
+    state->bb.o &= ~(1ull << cell);
+  }
+  for (uint i = 0; i < bb_cell_line_count[cell]; i++) {
+    uint l = bb_cell_lines[cell][i];
+    uint before = state->count_x[l] * EVAL_STEP_X + state->count_o[l];
+    score += eval_line_score[before - step] - eval_line_score[before];
+    eval_threat_flip(&delta, l, before, before - step);
+    if (own[l]-- == WIN_LENGTH) {
+      (*wins)--;
+    }
+  }
+  state->score = score;
+  state->filled--;
+  eval_threat_apply(state, &delta);
+}
+
+/*
+The function eval_rescan_scalar counts the pieces of every window with one
+population count per player.
+*/
+int32_t eval_rescan_scalar(const Bitboard *bb, uint8_t *count_x,
+                           uint8_t *count_o) {
+  int32_t score = 0;
+  for (uint l = 0; l < BB_LINE_COUNT; l++) {
+    uint x = __builtin_popcountll(bb->x & bb_lines[l]);
+    uint o = __builtin_popcountll(bb->o & bb_lines[l]);
+    score += eval_line_score[x * EVAL_STEP_X + o];
+    if (count_x != NULL) {
+      count_x[l] = x;
+    }
+    if (count_o != NULL) {
+      count_o[l] = o;
+    }
+  }
+  return score;
+}
+
+/*
+The function eval_rescan picks the instruction set on the first call.
+*/
+int32_t eval_rescan(const Bitboard *bb, uint8_t *count_x, uint8_t *count_o) {
+  if (eval_isa_used == EVAL_ISA_UNKNOWN) {
+    eval_detect();
+  }
+#if EVAL_X86
+  if (eval_isa_used == EVAL_ISA_AVX2) {
+    return eval_rescan_avx2(bb, count_x, count_o);
+  }
+#endif
+  return eval_rescan_scalar(bb, count_x, count_o);
+}
+
+/*
+The function eval_verify rebuilds a second state from the position and
+compares every field.
+*/
+bool eval_verify(const EvalState *state) {
+  EvalState fresh;
+  eval_from_board(&fresh, &state->bb);
+  return fresh.score == state->score && fresh.wins_x == state->wins_x &&
+         fresh.wins_o == state->wins_o && fresh.filled == state->filled &&
+         fresh.threat_count_x == state->threat_count_x &&
+         fresh.threat_count_o == state->threat_count_o &&
+         memcmp(fresh.count_x, state->count_x, sizeof(fresh.count_x)) == 0 &&
+         memcmp(fresh.count_o, state->count_o, sizeof(fresh.count_o)) == 0 &&
+         memcmp(fresh.threats_x, state->threats_x, sizeof(fresh.threats_x)) ==
+             0 &&
+         memcmp(fresh.threats_o, state->threats_o, sizeof(fresh.threats_o)) ==
+             0;
+}
+
+/*
+The function eval_threat_cells adds up the windows of every threat; the cells
+of a threat are all taken but one.
+*/
+BbMask eval_threat_cells(const EvalState *state, const char player) {
+  const uint32_t *threats = player == X ? state->threats_x : state->threats_o;
+  BbMask cells = 0;
+  if (!eval_has_threat(state, player)) {
+    return 0;
+  }
+  for (uint w = 0; w < EVAL_LINE_WORDS; w++) {
+    for (uint32_t bits = threats[w]; bits != 0; bits &= bits - 1) {
+      cells |= bb_lines[w * 32 + __builtin_ctz(bits)];
+    }
+  }
+  return cells & bb_empty(&state->bb);
+}
+
+/*
+The function eval_print_hint prints every winning cell of the player to move,
+or if there is none every cell the opponent wins at, which must be blocked.
+*/
+void eval_print_hint(const EvalState *state, const char player) {
+  char opponent = player == X ? O : X;
+  BbMask cells = eval_threat_cells(state, player);
+  const char *what = "win";
+  if (cells == 0) {
+    cells = eval_threat_cells(state, opponent);
+    what = "block";
+  }
+  for (; cells != 0; cells &= cells - 1) {
+    uint cell = __builtin_ctzll(cells);
+    printf("Hint: %c can %s at Row: %u Col: %u\n", player, what, cell / COLS,
+           cell % COLS);
+  }
+}
+
+/*
+The function eval_isa returns the name of the instruction set in use.
+*/
+const char *eval_isa(void) {
+  if (eval_isa_used == EVAL_ISA_UNKNOWN) {
+    eval_detect();
+  }
+  return eval_isa_used == EVAL_ISA_AVX2 ? "avx2" : "scalar";
+}
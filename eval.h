@@ -0,0 +1,214 @@
+#ifndef __EVAL_H__
+#define __EVAL_H__
+
+#include "bitboard.h"
+#include <stdint.h>
+
+// Pattern evaluator: every window of WIN_LENGTH cells (bb_lines) scores
+// eval_lut[own][opp], where own and opp are the pieces of each player in the
+// window. A position scores the sum over the windows of
+// eval_lut[x][o] - eval_lut[o][x] for X, the opposite for O. The piece counts
+// of every window and the score are updated from the windows through the cell
+// that changed only, so a move or its undo costs bb_cell_line_count[cell]
+// table lookups. Integer arithmetic only, the Cortex-M0+ has no FPU.
+//
+// The same update keeps the number of pieces on the board and, per player,
+// the set of threats: the windows one piece short of full with no piece of
+// the opponent. Wins, ties and threats are then answered without looking at
+// the board.
+
+#define EVAL_WIN 1000000 // Score of a won position for the winner
+#define EVAL_LUT_SIZE ((WIN_LENGTH + 1) * (WIN_LENGTH + 1))
+#define EVAL_LINE_WORDS ((BB_LINE_COUNT + 31) / 32) // Words of a window set
+
+_Static_assert(WIN_LENGTH < 256, "window counts are 8 bits");
+_Static_assert(WIN_LENGTH >= 2, "an empty window is never a threat");
+
+// Struct for storing a position and its evaluation
+// @field bb the position
+// @field count_x number of X pieces in every window of bb_lines
+// @field count_o number of O pieces in every window of bb_lines
+// @field wins_x number of windows full of X
+// @field wins_o number of windows full of O
+// @field threat_count_x number of windows in threats_x
+// @field threat_count_o number of windows in threats_o
+// @field filled number of pieces on the board
+// @field score sum of the window scores for X
+// @field threats_x windows X completes with one more piece, bit l is window l
+// @field threats_o windows O completes with one more piece
+typedef struct EvalState {
+  Bitboard bb;
+  uint8_t count_x[BB_LINE_COUNT];
+  uint8_t count_o[BB_LINE_COUNT];
+  uint16_t wins_x;
+  uint16_t wins_o;
+  uint16_t threat_count_x;
+  uint16_t threat_count_o;
+  uint8_t filled;
+  int32_t score;
+  uint32_t threats_x[EVAL_LINE_WORDS];
+  uint32_t threats_o[EVAL_LINE_WORDS];
+} EvalState;
+
+// Score of a window by (own, opp) piece counts, set by eval_init or
+// eval_set_lut
+extern int16_t eval_lut[WIN_LENGTH + 1][WIN_LENGTH + 1];
+// Score of a window for X by x * (WIN_LENGTH + 1) + o, derived from eval_lut
+extern int32_t eval_line_score[EVAL_LUT_SIZE];
+
+// ----------------------------------------
+// Evaluation functions
+// ----------------------------------------
+
+/**
+ * @brief Fills the default lookup table; must be called once after bb_init
+ *
+ * A window with pieces of both players scores 0. A window with k pieces of
+ * one player only scores 8^(k-1), and INT16_MAX when full.
+ */
+void eval_init(void);
+
+/**
+ * @brief Replaces the lookup table
+ *
+ * States evaluated with the old table must be rebuilt with eval_from_board.
+ *
+ * @param lut Score of a window by (own, opp) piece counts
+ */
+void eval_set_lut(const int16_t lut[WIN_LENGTH + 1][WIN_LENGTH + 1]);
+
+/**
+ * @brief Empties the position
+ *
+ * @param state Pointer to the evaluation state
+ */
+void eval_clear(EvalState *state);
+
+/**
+ * @brief Rebuilds the state of a position with a full rescan
+ *
+ * @param state Pointer to the evaluation state
+ * @param bb Pointer to the position
+ */
+void eval_from_board(EvalState *state, const Bitboard *bb);
+
+/**
+ * @brief Places a piece and updates the windows through its cell
+ *
+ * @param state Pointer to the evaluation state
+ * @param player The player's character
+ * @param cell Index of an empty cell
+ */
+void eval_place(EvalState *state, const char player, const uint cell);
+
+/**
+ * @brief Takes back a piece placed with eval_place
+ *
+ * @param state Pointer to the evaluation state
+ * @param player The player's character
+ * @param cell Index of the cell holding the player's piece
+ */
+void eval_remove(EvalState *state, const char player, const uint cell);
+
+/**
+ * @brief Returns the score of the position for a player
+ *
+ * @param state Pointer to the evaluation state
+ * @param player The player's character
+ * @return EVAL_WIN if the player has won, -EVAL_WIN if the opponent has won,
+ * the sum of the window scores for the player otherwise.
+ */
+static inline int32_t eval_score(const EvalState *state, const char player) {
+  if (state->wins_x != 0 || state->wins_o != 0) {
+    return (state->wins_x != 0) == (player == X) ? EVAL_WIN : -EVAL_WIN;
+  }
+  return player == X ? state->score : -state->score;
+}
+
+/**
+ * @brief Returns true if the player has a full window
+ *
+ * @param state Pointer to the evaluation state
+ * @param player The player's character
+ */
+static inline bool eval_is_win(const EvalState *state, const char player) {
+  return (player == X ? state->wins_x : state->wins_o) != 0;
+}
+
+/**
+ * @brief Returns true if the board is full and nobody has won
+ *
+ * @param state Pointer to the evaluation state
+ */
+static inline bool eval_is_tie(const EvalState *state) {
+  return state->filled == BB_CELLS && state->wins_x == 0 &&
+         state->wins_o == 0;
+}
+
+/**
+ * @brief Returns true if the player can win with one more piece
+ *
+ * @param state Pointer to the evaluation state
+ * @param player The player's character
+ */
+static inline bool eval_has_threat(const EvalState *state, const char player) {
+  return (player == X ? state->threat_count_x : state->threat_count_o) != 0;
+}
+
+/**
+ * @brief Returns the cells where the player wins with one more piece
+ *
+ * Walks the threats of the player only, so it returns right away when there
+ * are none.
+ *
+ * @param state Pointer to the evaluation state
+ * @param player The player's character
+ * @return The empty cell of every threat of the player.
+ */
+BbMask eval_threat_cells(const EvalState *state, const char player);
+
+/**
+ * @brief Prints the cells where the player to move wins, or else must block
+ *
+ * Prints nothing if neither player has a threat.
+ *
+ * @param state Pointer to the evaluation state
+ * @param player The player to move
+ */
+void eval_print_hint(const EvalState *state, const char player);
+
+/**
+ * @brief Counts the pieces of every window and scores a position from scratch
+ *
+ * Uses AVX2 on hosts that have it, the scalar path otherwise.
+ *
+ * @param bb Pointer to the position
+ * @param count_x Receives the X pieces of every window, may be NULL
+ * @param count_o Receives the O pieces of every window, may be NULL
+ * @return The sum of the window scores for X.
+ */
+int32_t eval_rescan(const Bitboard *bb, uint8_t *count_x, uint8_t *count_o);
+
+/**
+ * @brief eval_rescan without vector instructions
+ */
+int32_t eval_rescan_scalar(const Bitboard *bb, uint8_t *count_x,
+                           uint8_t *count_o);
+
+/**
+ * @brief Checks the incremental counts, threats and score against a full
+ * rescan
+ *
+ * @param state Pointer to the evaluation state
+ * @return true if they match, false otherwise.
+ */
+bool eval_verify(const EvalState *state);
+
+/**
+ * @brief Returns the name of the instruction set used by eval_rescan
+ *
+ * @return "avx2" or "scalar".
+ */
+const char *eval_isa(void);
+
+#endif
@@ -0,0 +1,377 @@
+#include "bitboard.h"
+#include "eval.h"
+#include "game.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Property-based fuzz harness for the button driven game state machine
+// Every input byte is one command fed through the same entry points as main:
+//   0: BTN1 (handle_btn1), only while the game is not over
+//   1: BTN2 (handle_btn2), only while the game is not over
+//   2: BTN3 (reset_board)
+//   3: update_position
+// After every command the state is checked against a reference model of the
+// state machine and against invariants of a legal game.
+//
+// Built with -DFUZZ_LIBFUZZER=ON the file is a libFuzzer target; otherwise it
+// has its own main that runs random inputs and reports executions per second:
+//   fuzz_game [iterations] [seed]
+
+#define CELLS (ROWS * COLS)
+#define FUZZ_MAX_INPUT 64 // Longest random input of the standalone driver
+
+// Struct for storing the game state passed to the entry points
+// @field eval evaluator kept next to board by handle_btn2_eval, emptied on
+// reset; unused by the reference model
+typedef struct {
+  char board[ROWS][COLS];
+  char current_player;
+  uint moves;
+  bool is_game_over;
+  EvalState eval;
+} FuzzGame;
+
+// ----------------------------------------
+// Reference model
+// ----------------------------------------
+
+/*
+The function ref_is_win is a naive reference for is_win. It walks every window
+of WIN_LENGTH cells in every direction directly on the character board.
+*/
+static bool ref_is_win(const char player, const char (*board)[COLS]) {
+  static const int dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+
+  // Try every start cell and every direction
+  for (int row = 0; row < ROWS; row++) {
+    for (int col = 0; col < COLS; col++) {
+      for (int d = 0; d < 4; d++) {
+        int count = 0;
+        int r = row;
+        int c = col;
+
+        // Count the player's pieces along the window
+        while (count < WIN_LENGTH && r >= 0 && r < ROWS && c >= 0 && c < COLS &&
+               board[r][c] == player) {
+          count++;
+          r += dirs[d][0];
+          c += dirs[d][1];
+        }
+        if (count == WIN_LENGTH) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+/*
+The function ref_is_tie is a naive reference for is_tie: the board is full.
+*/
+static bool ref_is_tie(const char (*board)[COLS]) {
+  for (int row = 0; row < ROWS; row++) {
+    for (int col = 0; col < COLS; col++) {
+      if (board[row][col] == EMPTY) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/*
+The function ref_reset is the reference for reset_board.
+*/
+static void ref_reset(FuzzGame *g) {
+  memset(g->board, EMPTY, sizeof(g->board));
+  g->current_player = X;
+  g->moves = 0;
+  g->is_game_over = false;
+}
+
+/*
+The function ref_step applies one command to the reference model.
+*/
+static void ref_step(FuzzGame *g, const uint8_t cmd) {
+  switch (cmd) {
+  case 0: // BTN1 and update_position both move the cursor forward
+  case 3:
+    g->moves = g->moves + 1 < CELLS ? g->moves + 1 : 0;
+    break;
+  case 1: { // BTN2 places a piece on an empty cell
+    char *cell = &g->board[g->moves / COLS][g->moves % COLS];
+    if (*cell != EMPTY) {
+      break;
+    }
+    *cell = g->current_player;
+    if (ref_is_win(g->current_player, g->board)) {
+      g->is_game_over = true;
+    } else if (ref_is_tie(g->board)) {
+      ref_reset(g);
+    } else {
+      g->moves = 0;
+      g->current_player = g->current_player == X ? O : X;
+    }
+    break;
+  }
+  case 2: // BTN3 resets the game
+    ref_reset(g);
+    break;
+  }
+}
+
+// ----------------------------------------
+// Harness
+// ----------------------------------------
+
+/*
+The function fuzz_fail reports a broken property and aborts, which is how
+libFuzzer detects a crash.
+*/
+static void fuzz_fail(const char *what, const size_t step) {
+  fprintf(stderr, "fuzz_game: %s after step %zu\n", what, step);
+  abort();
+}
+
+/*
+The function fuzz_check verifies the state after a step:
+  - the state matches the reference model,
+  - the cursor is on the board and the player is X or O,
+  - every cell is EMPTY, X or O and the piece counts alternate from X,
+  - the game is over exactly when the current player has won,
+  - is_win and is_tie agree with the naive references,
+  - the tracked evaluator holds the board, its incremental counts, threats and
+    score match a rescan, its win and tie queries agree with the references,
+    its threat cells are exactly the cells that win, and the vector and scalar
+    rescans agree.
+*/
+static void fuzz_check(const FuzzGame *g, const FuzzGame *ref,
+                       const size_t step) {
+  // Compare with the reference model
+  if (memcmp(g->board, ref->board, sizeof(g->board)) != 0) {
+    fuzz_fail("board differs from reference", step);
+  }
+  if (g->current_player != ref->current_player) {
+    fuzz_fail("current_player differs from reference", step);
+  }
+  if (g->moves != ref->moves) {
+    fuzz_fail("moves differs from reference", step);
+  }
+  if (g->is_game_over != ref->is_game_over) {
+    fuzz_fail("is_game_over differs from reference", step);
+  }
+
+  // Cursor and player
+  if (g->moves >= CELLS) {
+    fuzz_fail("moves out of range", step);
+  }
+  if (g->current_player != X && g->current_player != O) {
+    fuzz_fail("invalid current_player", step);
+  }
+
+  // Cell contents and piece counts
+  int count_x = 0;
+  int count_o = 0;
+  for (int row = 0; row < ROWS; row++) {
+    for (int col = 0; col < COLS; col++) {
+      char cell = g->board[row][col];
+      if (cell != EMPTY && cell != X && cell != O) {
+        fuzz_fail("invalid cell value", step);
+      }
+      count_x += cell == X;
+      count_o += cell == O;
+    }
+  }
+  // X moves first; after a win the winner is still the current player
+  int expected = (g->current_player == O) != g->is_game_over ? 1 : 0;
+  if (count_x - count_o != expected) {
+    fuzz_fail("piece counts do not alternate", step);
+  }
+
+  // Game over flag
+  bool x_wins = ref_is_win(X, g->board);
+  bool o_wins = ref_is_win(O, g->board);
+  if (g->is_game_over != (g->current_player == X ? x_wins : o_wins)) {
+    fuzz_fail("is_game_over does not match the winner", step);
+  }
+  if (x_wins && o_wins) {
+    fuzz_fail("both players win", step);
+  }
+
+  // Cross-check the game status functions
+  if (is_win(X, g->board) != x_wins || is_win(O, g->board) != o_wins) {
+    fuzz_fail("is_win disagrees with reference", step);
+  }
+  if (is_tie(g->board) != ref_is_tie(g->board)) {
+    fuzz_fail("is_tie disagrees with reference", step);
+  }
+
+  // Evaluator kept by handle_btn2_eval
+  Bitboard bb;
+  bb_from_board(g->board, &bb);
+  if (g->eval.bb.x != bb.x || g->eval.bb.o != bb.o) {
+    fuzz_fail("tracked evaluator differs from board", step);
+  }
+  if (!eval_verify(&g->eval)) {
+    fuzz_fail("incremental evaluation differs from rescan", step);
+  }
+  if (eval_is_win(&g->eval, X) != x_wins ||
+      eval_is_win(&g->eval, O) != o_wins ||
+      eval_is_tie(&g->eval) != (ref_is_tie(g->board) && !x_wins && !o_wins)) {
+    fuzz_fail("tracked win or tie disagrees with reference", step);
+  }
+  // The threat cells are the empty cells that win
+  for (uint cell = 0; cell < BB_CELLS; cell++) {
+    for (uint p = 0; p < 2; p++) {
+      char player = p ? O : X;
+      bool wins = false;
+      if (((bb_empty(&bb) >> cell) & 1) != 0) {
+        Bitboard next = bb;
+        bb_place(&next, player, cell);
+        wins = bb_is_win_at(bb_pieces(&next, player), cell);
+      }
+      if (wins != ((eval_threat_cells(&g->eval, player) >> cell) & 1)) {
+        fuzz_fail("threat cells differ from winning cells", step);
+      }
+    }
+  }
+  uint8_t vec_x[BB_LINE_COUNT];
+  uint8_t vec_o[BB_LINE_COUNT];
+  uint8_t sca_x[BB_LINE_COUNT];
+  uint8_t sca_o[BB_LINE_COUNT];
+  if (eval_rescan(&bb, vec_x, vec_o) != eval_rescan_scalar(&bb, sca_x, sca_o) ||
+      memcmp(vec_x, sca_x, sizeof(vec_x)) != 0 ||
+      memcmp(vec_o, sca_o, sizeof(vec_o)) != 0) {
+    fuzz_fail("vector rescan disagrees with scalar rescan", step);
+  }
+}
+
+/*
+The function LLVMFuzzerTestOneInput starts a new game and feeds every input
+byte as one command, checking the properties after each of them.
+*/
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  FuzzGame game;
+  FuzzGame ref;
+
+  // Start from a fresh game on both sides
+  hal_sim_reset();
+  reset_board(&game.current_player, &game.moves, game.board,
+              &game.is_game_over);
+  eval_clear(&game.eval);
+  ref_reset(&ref);
+  fuzz_check(&game, &ref, 0);
+
+  for (size_t i = 0; i < size; i++) {
+    uint8_t cmd = data[i] & 3;
+
+    // Feed the command through the same entry points as main
+    switch (cmd) {
+    case 0:
+      if (game.is_game_over) {
+        continue;
+      }
+      handle_btn1(&game.moves);
+      break;
+    case 1:
+      if (game.is_game_over) {
+        continue;
+      }
+      handle_btn2_eval(&game.current_player, &game.moves, game.board,
+                       &game.is_game_over, &game.eval);
+      break;
+    case 2:
+      reset_board(&game.current_player, &game.moves, game.board,
+                  &game.is_game_over);
+      eval_clear(&game.eval);
+      break;
+    case 3:
+      update_position(&game.moves);
+      break;
+    }
+
+    // Apply the same command to the reference and compare
+    ref_step(&ref, cmd);
+    fuzz_check(&game, &ref, i + 1);
+
+    // Core1 would consume the winner, keep the FIFO from overflowing
+    while (multicore_fifo_rvalid()) {
+      multicore_fifo_pop_blocking();
+    }
+  }
+
+  return 0;
+}
+
+/*
+The function LLVMFuzzerInitialize builds the window tables and silences the
+game output; printing every board would dominate the execution time.
+*/
+int LLVMFuzzerInitialize(int *argc, char ***argv) {
+  (void)argc;
+  (void)argv;
+  bb_init();
+  eval_init();
+  if (freopen("/dev/null", "w", stdout) == NULL) {
+    fprintf(stderr, "fuzz_game: cannot silence stdout\n");
+  }
+  return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+/*
+The standalone driver generates random inputs with a xorshift generator, so a
+seed always replays the same inputs, and prints the executions per second
+every second and at the end.
+*/
+int main(int argc, char **argv) {
+  uint64_t iterations = argc > 1 ? strtoull(argv[1], NULL, 0) : 1000000;
+  uint32_t rng = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 1;
+  uint8_t input[FUZZ_MAX_INPUT];
+
+  LLVMFuzzerInitialize(&argc, &argv);
+  rng = rng ? rng : 1;
+
+  uint64_t start_us = time_us_64();
+  uint64_t report_us = start_us;
+  uint64_t commands = 0;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    // Random length and contents
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    size_t size = 1 + rng % FUZZ_MAX_INPUT;
+    for (size_t j = 0; j < size; j++) {
+      rng ^= rng << 13;
+      rng ^= rng >> 17;
+      rng ^= rng << 5;
+      input[j] = (uint8_t)rng;
+    }
+
+    LLVMFuzzerTestOneInput(input, size);
+    commands += size;
+
+    // Report once per second
+    uint64_t now = time_us_64();
+    if (now - report_us >= 1000000) {
+      fprintf(stderr, "fuzz_game: %llu execs, %llu exec/s\n",
+              (unsigned long long)(i + 1),
+              (unsigned long long)((i + 1) * 1000000ull / (now - start_us)));
+      report_us = now;
+    }
+  }
+
+  uint64_t elapsed_us = time_us_64() - start_us;
+  if (elapsed_us == 0) {
+    elapsed_us = 1;
+  }
+  fprintf(stderr, "fuzz_game: %llu execs, %llu commands in %llu ms, "
+                  "%llu exec/s\n",
+          (unsigned long long)iterations, (unsigned long long)commands,
+          (unsigned long long)(elapsed_us / 1000),
+          (unsigned long long)(iterations * 1000000ull / elapsed_us));
+  return 0;
+}
+#endif
@@ -1,5 +1,8 @@
 #include "game.h"
-#include "pico/multicore.h"
+#include "engine_async.h"
+#include "eval.h"
+#include "gpio_drv.h"
+#include "idle.h"
 #include <stdint.h>
 
 // ----------------------------------------
@@ -9,26 +12,35 @@
 /*
 The init_gpio function initializes a set of GPIO (General Purpose Input/Output)
 pins by performing the following actions:
-  - Looping through an array of GpioConfig structures (gpio) of length len.
-  - For each GpioConfig structure in the array, it calls the gpio_init function
-with the pin_number field as an argument. This initializes the specified
-GPIO pin.
-  - Then, it calls the gpio_set_dir function with the pin_number field and the
-pin_dir field as arguments. This sets the direction (input or output) of
-the specified GPIO pin.
+  - Looping through an array of GpioConfig structures (gpio) of length len and
+collecting a mask of all the pins and a mask of the output pins.
+  - Calling gpio_init_mask once with the mask of all the pins. This initializes
+every specified GPIO pin.
+  - Calling gpio_set_dir_masked once with both masks. This sets the direction
+(input or output) of every specified GPIO pin.
+The firmware configures its pins with gpio_drv_init; init_gpio keeps the same
+masked calls for callers that list their pins at run time.
 */
 // Define a function named "init_gpio" that takes in two arguments, a pointer to
 // a GpioConfig structure and the size of the GpioConfig array
 void init_gpio(GpioConfig *gpio, size_t len) {
-  // Loop through the length of the GpioConfig array
-
-    // Initialize the GPIO specified by the pin number in the current GpioConfig
-    // structure
+  uint32_t all_mask = 0;
+  uint32_t out_mask = 0;
 
-    // Set the direction of the GPIO specified by the pin number and direction
-    // in the current GpioConfig structure
+  // Loop through the length of the GpioConfig array
+  for (size_t i = 0; i < len; i++) {
+    // Add the pin, and its direction bit if it is an output
+    all_mask |= 1u << gpio[i].pin_number;
+    if (gpio[i].pin_dir == GPIO_OUT) {
+      out_mask |= 1u << gpio[i].pin_number;
+    }
+  }
 
+  // Initialize every GPIO of the array at once
+  gpio_init_mask(all_mask);
 
+  // Set the direction of every GPIO of the array at once
+  gpio_set_dir_masked(all_mask, out_mask);
 }
 
 // ----------------------------------------
@@ -49,7 +61,7 @@ bool debounce(const volatile BtnState btn) {
   // Check if the previous state and current state of the button have changed
   if (has_changed(btn.prev_state, btn.curr_state)) {
     // Check if the current state of the button is stable
-    if (is_stable(btn.but_pin, btn.curr_state)) {
+    if (is_stable(btn.but_pin, btn.stable_ticks)) {
       // Return true if the state has changed and is stable
       return true;
     }
@@ -61,32 +73,33 @@ bool debounce(const volatile BtnState btn) {
 /*
 The function is_stable is part of a debouncing routine used to filter out
 electrical noise from a button press. It takes two arguments: button
-(representing the button pin number), and prev_state (representing the previous
-state of the button).
-It first waits for a specified time DEBOUNCE_DELAY in microseconds (used
-to wait for the electrical noise to settle), and then it reads the current state
-of the button using the gpio_get function.
-If the previous state of the button is HIGH and the current state is also HIGH,
-it returns true and outputs a message indicating that the button state is
-stable. If the two states do not match, it returns false.
+(representing the button pin number), and stable_ticks (the number of input
+ticks the pin has read the same level).
+It does not wait: update_btn_state counts the samples taken every
+DEBOUNCE_TICK_US by the input task, and the level is stable once it has been
+read for DEBOUNCE_TICKS ticks in a row, which spans DEBOUNCE_DELAY. The input
+task thus stays within a few microseconds per run while a press settles.
 */
 // Define a function named "is_stable" that takes in a constant uint
-// (representing the button pin number) and a constant bool (representing the
-// previous state of the button)
-bool is_stable(const uint button, const bool prev_state) {
-  // Wait for a specific amount of time (DEBOUNCE_DELAY)
-
-  // Get the current state of the button
-
-  // Check if the previous state and current state of the button are both high
-
+// (representing the button pin number) and a constant uint (representing the
+// number of ticks the button level has not changed)
+bool is_stable(const uint button, const uint stable_ticks) {
+  // Check if the level has been read for the whole debounce delay
+  if (stable_ticks >= DEBOUNCE_TICKS) {
     // Optionally print a message if the button state is stable (only if the
     // preprocessor macro "VERBOSE" is defined)
+#ifdef VERBOSE
+    printf("Button %u state is stable\n", button);
+#else
+    (void)button;
+#endif
 
     // Return true if the button state is stable
+    return true;
+  }
 
   // Return false if the button state is not stable
-
+  return false;
 }
 
 /*
@@ -104,37 +117,59 @@ false.
 // previous state and current state of the button
 bool has_changed(bool prev_state, bool curr_state) {
   // Check if the previous state is LOW and the current state is HIGH
+  bool changed = prev_state == LOW && curr_state == HIGH;
 
   // Optionally print a message if the button state has changed (only if the
   // preprocessor macro "VERBOSE" is defined)
+#ifdef VERBOSE
+  if (changed) {
+    printf("Button state has changed\n");
+  }
+#endif
 
   // Return true if the button state has changed, false otherwise
-
+  return changed;
 }
 
 /*
 The function update_btn_state updates the state of a button. It takes a pointer
-to a BtnState struct, btn, as its argument.
+to a BtnState struct, btn, as its argument. It is called once per input tick.
 The function checks the current state of the button (btn->curr_state) and
 updates the previous state (btn->prev_state) accordingly. If the current state
 is 0, it sets the previous state to 0. If the current state is 1, it sets the
 previous state to 1.
-Finally, it updates the current state of the button (btn->curr_state) by calling
-the gpio_get function and passing the button pin number (btn->but_pin) as an
-argument.
+Then it reads the button pin with gpio_get. A level that differs from the last
+sample restarts the count of stable ticks (btn->stable_ticks). Only a level
+that has been read for DEBOUNCE_TICKS ticks in a row becomes the current state,
+so bounces never reach it and a press shows up as one LOW to HIGH change.
 */
 // Define a function named "update_btn_state" that takes in a pointer to a
 // volatile BtnState structure
 void update_btn_state(volatile BtnState *btn) {
   // Check if the current state of the button is 0
-
+  if (btn->curr_state == 0) {
     // If so, set the previous state of the button to 0
-
+    btn->prev_state = 0;
+  }
   // Check if the current state of the button is 1
-
+  else if (btn->curr_state == 1) {
     // If so, set the previous state of the button to 1
+    btn->prev_state = 1;
+  }
 
-  // Update the current state of the button by reading the button pin
+  // Read the button pin and count the ticks it keeps the same level
+  bool level = gpio_get(btn->but_pin);
+  if (level != btn->raw_state) {
+    btn->raw_state = level;
+    btn->stable_ticks = 0;
+  } else if (btn->stable_ticks < DEBOUNCE_TICKS) {
+    btn->stable_ticks++;
+  }
+
+  // Update the current state of the button once the level is stable
+  if (is_stable(btn->but_pin, btn->stable_ticks)) {
+    btn->curr_state = btn->raw_state;
+  }
 }
 
 // ----------------------------------------
@@ -157,25 +192,35 @@ and print_player_turn (to print the current player's turn).
 void reset_board(char *current_player, uint *moves, char (*board)[COLS],
                  bool *is_game_over) {
   // Print a message indicating that the board is being reset
+  printf("Resetting the board ...\n");
 
   // Loop over the rows and columns of the game board
-
+  for (uint row = 0; row < ROWS; row++) {
+    for (uint col = 0; col < COLS; col++) {
       // Set each cell of the game board to the "EMPTY" value
+      board[row][col] = EMPTY;
+    }
+  }
 
   // Reset the number of moves to 0
+  *moves = 0;
 
   // Reset the current player to "X"
+  *current_player = X;
 
   // Reset the game over flag to false
+  *is_game_over = false;
 
   // Call the function "print_board" with the game board as an argument
+  print_board((const char(*)[COLS])board);
 
   // Call the function "print_player_turn" with the current player as an
   // argument
+  print_player_turn(*current_player);
 
   // Call the function "multicore_fifo_push_blocking" with "EMPTY" as an
   // argument
-
+  multicore_fifo_push_blocking(EMPTY);
 }
 
 /*
@@ -190,8 +235,8 @@ returns 1. This calculation assumes that the game board has 3 ROWS and COLS.
 // in the game
 uint get_curr_row(const uint moves) {
   // Return the current row in the game board by dividing the number of moves by
-  // the number of rows
-
+  // the number of columns
+  return moves / COLS;
 }
 
 /*
@@ -206,8 +251,8 @@ board has 3 ROWS and COLS.
 // in the game
 uint get_next_row(const uint moves) {
   // Return the next row in the game board by dividing the number of moves plus
-  // one by the number of rows
-
+  // one by the number of columns
+  return (moves + 1) / COLS;
 }
 
 /*
@@ -224,7 +269,7 @@ the game board has 3 ROWS and COLS.
 uint get_next_col(const uint moves) {
   // Return the next column in the game board by taking the remainder of the
   // number of moves plus one divided by the number of columns
-
+  return (moves + 1) % COLS;
 }
 
 /*
@@ -241,7 +286,7 @@ ROWS and COLS.
 uint get_curr_col(const uint moves) {
   // Return the current column in the game board by taking the remainder of the
   // number of moves divided by the number of columns
-
+  return moves % COLS;
 }
 
 /*
@@ -259,17 +304,22 @@ from the top-left corner of the board.
 // Increment the move counter to update the current position of game
 void update_position(uint *moves) {
   // Calculate the next row and column of the board
+  uint next_row = get_next_row(*moves);
+  uint next_col = get_next_col(*moves);
 
   // Check if the next position is within the valid range of the board
-
+  if (is_valid_pos(next_row, next_col)) {
     // Increment the move counter
-
+    (*moves)++;
+  } else {
     // If the end of the board is reached, start again from the top
 
     // Print message to indicate start of new round
+    printf("End of the board, starting again from the top\n");
 
     // Reset the move counter
-
+    *moves = 0;
+  }
 }
 
 /*
@@ -282,7 +332,7 @@ of row and col to the console. The message "Row: %u Col: %u\n" is printed, where
 void print_curr_pos(const uint row, const uint col) {
   // Print a string "Row: %u Col: %u\n" with the values of "row" and "col"
   // replacing the placeholders %u
-
+  printf("Row: %u Col: %u\n", row, col);
 }
 
 /*
@@ -298,8 +348,8 @@ and row < ROWS (where ROWS is a constant value), and col >= 0 and col < COLS
 // board
 bool is_valid_pos(const uint row, const uint col) {
   // Return true if both row and column are greater than or equal to 0 and less
-  // than ROWS and COLS respectively
-
+  // than ROWS and COLS respectively (both are unsigned, so never below 0)
+  return row < ROWS && col < COLS;
 }
 
 /*
@@ -310,7 +360,21 @@ otherwise.
 */
 bool is_empty_pos(uint const row, uint const col, const char (*board)[COLS]) {
   // return true if the cell is empty otherwise return false
+  return board[row][col] == EMPTY;
+}
 
+/*
+The function place_piece enters the current player's symbol into the board at
+the position specified by moves count, without printing anything. It is the
+cell write of update_board, also used to replay stored moves.
+*/
+// Declare a function named "place_piece" that takes in the current player as a
+// char, number of moves as an unsigned int, and a 2D character array "board"
+void place_piece(const char current_player, const uint moves,
+                 char (*board)[COLS]) {
+  // Update the board at the row and col of moves with the current player's
+  // input
+  board[get_curr_row(moves)][get_curr_col(moves)] = current_player;
 }
 
 /*
@@ -319,7 +383,7 @@ player's symbol (either 'X' or 'O') at the position specified by moves count.
 The row and col values are calculated from the moves count using the functions
 get_curr_row and get_curr_col. If the calculated position is a valid position on
 the board, then the current player's symbol is entered into that position on the
-board, and a message indicating this is printed to the console.
+board with place_piece, and a message indicating this is printed to the console.
 */
 // Declare a function named "update_board" that takes in the current player as a
 // char, number of moves as an unsigned int, and a 2D character array "board"
@@ -327,37 +391,43 @@ void update_board(const char current_player, const uint moves,
                   char (*board)[COLS]) {
   // Calculate the row by calling "get_curr_row" function with the number of
   // moves
+  uint row = get_curr_row(moves);
 
   // Calculate the col by calling "get_curr_col" function with the number of
   // moves
+  uint col = get_curr_col(moves);
 
   // Print the current player and the row and col where the player's input is
   // being entered
+  printf("Player %c enters Row: %u Col: %u\n", current_player, row, col);
 
   // Update the board at the calculated row and col with the current player's
   // input
-
+  place_piece(current_player, moves, board);
 }
 
 /*
 This function print_board takes a 2D character array board as input and prints
-it in a Tic Tac Toe board format. The board is displayed as three rows and three
+it in a Tic Tac Toe board format. The board is displayed as ROWS rows and COLS
 columns separated by | symbols and lines with + symbols. The value of each cell
 of the board is displayed inside each cell.
 */
 // Declare a function named "print_board" that takes in a 2D character array
 // "board"
 void print_board(const char (*board)[COLS]) {
-  // Print the first row of the board
-
-  // Print the separator line
-
-  // Print the second row of the board
-
-  // Print the separator line
-
-  // Print the third row of the board
+  // Print every row of the board
+  for (uint row = 0; row < ROWS; row++) {
+    for (uint col = 0; col < COLS; col++) {
+      printf(col + 1 < COLS ? " %c |" : " %c\n", board[row][col]);
+    }
 
+    // Print the separator line
+    if (row + 1 < ROWS) {
+      for (uint col = 0; col < COLS; col++) {
+        printf(col + 1 < COLS ? "---+" : "---\n");
+      }
+    }
+  }
 }
 
 /*
@@ -367,7 +437,7 @@ game. The message includes the value of current_player and the text "turn".
 */
 void print_player_turn(const char current_player) {
   // Print the "Player %c turn\n", current_player message
-
+  printf("Player %c turn\n", current_player);
 }
 
 // ----------------------------------------
@@ -380,22 +450,27 @@ based on the current turn of the player in a game of Tic-Tac-Toe. If the current
 player is X, then LED1 is set to HIGH and LED2 is set to LOW. If the current
 player is O, then LED1 is set to LOW and LED2 is set to HIGH. If the current
 player is neither X nor O, then both LED1 and LED2 are set to HIGH.
+Both LEDs are written together through gpio_drv_put_masked, which skips the
+register write when the LEDs already show the current player.
 */
 // Declare a function named "update_player_led" that takes in the current player
 // as a char
 void update_player_led(const char current_player) {
   // Check if the current player is "X"
-
+  if (current_player == X) {
     // Turn on LED1 and turn off LED2 if the current player is "X"
-
+    gpio_drv_put_masked(PLAYER_LED_MASK, 1u << LED1);
+  }
   // Check if the current player is "O"
-
+  else if (current_player == O) {
     // Turn off LED1 and turn on LED2 if the current player is "O"
-
+    gpio_drv_put_masked(PLAYER_LED_MASK, 1u << LED2);
+  }
   // If the current player is neither "X" nor "O"
-
+  else {
     // Turn off both LED1 and LED2
-
+    gpio_drv_put_masked(PLAYER_LED_MASK, 0);
+  }
 }
 
 /*
@@ -406,43 +481,60 @@ winner of the game by popping the data from the FIFO. Based on the winner, the
 function selects an LED (LED1, LED2, or ONBOARD_LED) to flash. The selected LED
 is set to a high state for a specified amount of time (BLINK_LED_DELAY) and then
 set to a low state for the same amount of time.
+The delays are spent in engine_async_sleep_ms, which makes core1 the engine
+compute service: searches posted by core0 run between the blinks.
+The LED is written through gpio_drv_put_masked like the player LEDs of core0,
+so the output cache of the driver always holds what the LEDs show.
 */
 void flash_winner_led() {
   // Declare a variable "winner" of type uint32_t and initialize it to the value
   // of "EMPTY"
-
+  uint32_t winner = EMPTY;
   // Declare a variable "led_pin" of type uint and initialize it to the value of
   // "ONBOARD_LED"
+  uint led_pin = ONBOARD_LED;
 
   // Start an infinite loop
   while (true) {
+    // Park core1 while core0 sleeps and no winner is pending
+    idle_core1_wait();
 
     // Check if the function "multicore_fifo_rvalid()" returns true
-
+    if (multicore_fifo_rvalid()) {
       // Pop a value from the "multicore_fifo" and store it in the variable
       // "winner"
-
-
+      winner = multicore_fifo_pop_blocking();
+    }
 
     // Check if the value stored in "winner" is equal to 'X'
-
+    if (winner == X) {
       // If yes, set the value of "led_pin" to "LED1"
-
-      // Check if the value stored in "winner" is equal to 'O'
-
+      led_pin = LED1;
+    }
+    // Check if the value stored in "winner" is equal to 'O'
+    else if (winner == O) {
       // If yes, set the value of "led_pin" to "LED2"
-
+      led_pin = LED2;
+    } else {
       // If the value of "winner" is neither 'X' nor 'O', set the value of
       // "led_pin" to "ONBOARD_LED"
+      led_pin = ONBOARD_LED;
+    }
 
-    // Set the value of the "led_pin" to "HIGH"
-
-    // Sleep for "BLINK_LED_DELAY" milliseconds
+    // Set the value of the "led_pin" to "HIGH" through the GPIO driver, which
+    // core0 also uses for the player LEDs
+    gpio_drv_put_masked(1u << led_pin, (uint32_t)HIGH << led_pin);
 
-    // Set the value of the "led_pin" to "LOW"
+    // Sleep for "BLINK_LED_DELAY" milliseconds, running engine searches posted
+    // by core0 meanwhile
+    engine_async_sleep_ms(BLINK_LED_DELAY);
 
-    // Sleep for "BLINK_LED_DELAY" milliseconds
+    // Set the value of the "led_pin" to "LOW" through the GPIO driver
+    gpio_drv_put_masked(1u << led_pin, (uint32_t)LOW << led_pin);
 
+    // Sleep for "BLINK_LED_DELAY" milliseconds, running engine searches posted
+    // by core0 meanwhile
+    engine_async_sleep_ms(BLINK_LED_DELAY);
   }
 }
 
@@ -458,14 +550,17 @@ passing moves as the argument.
 */
 void handle_btn1(uint *moves) {
   // Update the position of moves
-  
+  update_position(moves);
+
   // Call the function "get_curr_row" with the parameter "moves" and store the
   // result in a variable "curr_row"
+  uint curr_row = get_curr_row(*moves);
   // Call the function "get_curr_col" with the parameter "moves" and store the
   // result in a variable "curr_col"
+  uint curr_col = get_curr_col(*moves);
   // Call the function "print_curr_pos" with parameters "curr_row" and
   // "curr_col" to print the updated position
-  
+  print_curr_pos(curr_row, curr_col);
 }
 
 /*
@@ -486,67 +581,109 @@ message and resets the game.
 prints a tie message and resets the game.
   - If the game is not over, it updates the current player, resets the moves
 value to 0, and prints the turn for the next player.
+It is handle_btn2_eval without an evaluator, so the board is scanned with is_win
+and is_tie.
 */
 void handle_btn2(char *current_player, uint *moves, char (*board)[COLS],
                  bool *is_game_over) {
+  handle_btn2_eval(current_player, moves, board, is_game_over, NULL);
+}
+
+/*
+The function handle_btn2_eval is handle_btn2 for a board that has an evaluator
+state next to it. The move is also placed into eval and a reset empties it, so
+the win and tie checks are O(1) reads of eval (eval_is_win, eval_is_tie)
+instead of scans of the board. Without an evaluator (eval is NULL) the board is
+scanned with is_win and is_tie.
+*/
+void handle_btn2_eval(char *current_player, uint *moves, char (*board)[COLS],
+                      bool *is_game_over, EvalState *eval) {
   // Call the function "get_curr_row" with the parameter "moves" and store the
   // result in a variable "row"
-  
+  uint row = get_curr_row(*moves);
+
   // Call the function "get_curr_col" with the parameter "moves" and store the
   // result in a variable "col"
-  
+  uint col = get_curr_col(*moves);
 
   // Check if the position (row, col) is valid
-  
+  if (!is_valid_pos(row, col)) {
     // If the position is not valid, print a message "Invalid selection row %d
     // col %d" with row and col values
-  
+    printf("Invalid selection row %u col %u\n", row, col);
+
     // Return from the function
-  
-  
+    return;
+  }
 
   // Check if the position (row, col) is empty
-
+  if (!is_empty_pos(row, col, (const char(*)[COLS])board)) {
     // If the position is not empty, print a message "row %d col %d is not
     // empty" with row and col values Print another message "Please select
     // another location."
+    printf("row %u col %u is not empty\n", row, col);
+    printf("Please select another location.\n");
 
     // Return from the function
-
-
+    return;
+  }
 
   // Call the function "update_board" with parameters *current_player, *moves,
   // board to update the board
+  update_board(*current_player, *moves, board);
 
   // Call the function "print_board" with parameter board to print the board
-
+  print_board((const char(*)[COLS])board);
+
+  // Get the win and tie status from the evaluator, or else from the board
+  bool win;
+  bool tie;
+  if (eval != NULL) {
+    eval_place(eval, *current_player, *moves);
+    win = eval_is_win(eval, *current_player);
+    tie = eval_is_tie(eval);
+  } else {
+    win = is_win(*current_player, (const char(*)[COLS])board);
+    tie = is_tie((const char(*)[COLS])board);
+  }
 
   // Check if there's a win
-
+  if (win) {
     // If there's a win, print a message "Player %c wins!" with *current_player
+    printf("Player %c wins!\n", *current_player);
 
     // Call the function "multicore_fifo_push_blocking" with parameter
     // *current_player to push the winner
+    multicore_fifo_push_blocking(*current_player);
 
     // Set *is_game_over to true
+    *is_game_over = true;
 
     // Print messages "Please press reset button to start the game." and
     // "Waiting for the reset ..."
-
+    printf("Please press reset button to start the game.\n");
+    printf("Waiting for the reset ...\n");
+  } else if (tie) {
     // If it's a tie game, print the message "Tie game!"
+    printf("Tie game!\n");
 
     // Call the function "reset_board" with parameters "current_player",
-    // "moves", "board", and "is_game_over"
-
-
+    // "moves", "board", and "is_game_over", and empty the evaluator
+    reset_board(current_player, moves, board, is_game_over);
+    if (eval != NULL) {
+      eval_clear(eval);
+    }
+  } else {
     // If there's no win or tie, set *moves to 0
+    *moves = 0;
 
     // Call the function "get_new_player" with parameter *current_player and
     // store the result in *current_player
-
+    *current_player = get_new_player(*current_player);
 
     // Call the function `print_player_turn` to print which player's turn it is
-
+    print_player_turn(*current_player);
+  }
 }
 
 // ----------------------------------------
@@ -561,7 +698,7 @@ switch the player from one to the other.
 */
 char get_new_player(char current_player) {
   // Return the next player symbol
-  
+  return current_player == X ? O : X;
 }
 
 /*
@@ -569,7 +706,8 @@ This function is_win takes two arguments, player and board, and returns a
 boolean value indicating whether the given player has won the game by checking
 the board.
 The function checks each row, each column, and both diagonals for the presence
-of three consecutive squares filled by the player. If any of the checks returns
+of WIN_LENGTH consecutive squares filled by the player (three on the classic
+board). If any of the checks returns
 true, it means the player has won the game, so the function returns true. If all
 the checks fail, the function returns false meaning the player has not won the
 game.
@@ -577,34 +715,59 @@ game.
 // Check if the given player has won the game
 bool is_win(const char player, const char (*board)[COLS]) {
   // Check rows
-  
-    // Check if all elements in the row are equal to the player
-  
-  
-      // Player wins
-  
-  
-  
+  for (uint row = 0; row < ROWS; row++) {
+    // Check if WIN_LENGTH elements in a row are equal to the player
+    uint run = 0;
+    for (uint col = 0; col < COLS; col++) {
+      run = board[row][col] == player ? run + 1 : 0;
+      if (run == WIN_LENGTH) {
+        // Player wins
+        return true;
+      }
+    }
+  }
+
   // Check columns
-  
-    // Check if all elements in the column are equal to the player
-  
-  
-      // return to true to indicate player wins
-    
-  // Check diagonals
-  // Check if all elements in the first diagonal are equal to the player
-  
-    // Player wins
-  
-  
-  // Check if all elements in the second diagonal are equal to the player
-  
-    // Player wins
-  
-  
+  for (uint col = 0; col < COLS; col++) {
+    // Check if WIN_LENGTH elements in a column are equal to the player
+    uint run = 0;
+    for (uint row = 0; row < ROWS; row++) {
+      run = board[row][col] == player ? run + 1 : 0;
+      if (run == WIN_LENGTH) {
+        // return to true to indicate player wins
+        return true;
+      }
+    }
+  }
+
+  // Check diagonals, from every cell where one fits on the board
+  for (uint row = 0; row + WIN_LENGTH <= ROWS; row++) {
+    for (uint col = 0; col + WIN_LENGTH <= COLS; col++) {
+      // Check if all elements in the first diagonal are equal to the player
+      uint len = 0;
+      while (len < WIN_LENGTH && board[row + len][col + len] == player) {
+        len++;
+      }
+      if (len == WIN_LENGTH) {
+        // Player wins
+        return true;
+      }
+
+      // Check if all elements in the second diagonal are equal to the player
+      len = 0;
+      while (len < WIN_LENGTH &&
+             board[row + len][col + WIN_LENGTH - 1 - len] == player) {
+        len++;
+      }
+      if (len == WIN_LENGTH) {
+        // Player wins
+        return true;
+      }
+    }
+  }
+
   // Player has not won
-  
+  return false;
 }
 
 /*
@@ -616,16 +779,17 @@ filled and the function has not returned yet, it returns true.
 */
 bool is_tie(const char (*board)[COLS]) {
   // Iterate over each row of the board
-  
+  for (uint row = 0; row < ROWS; row++) {
     // Iterate over each column of the board
-  
+    for (uint col = 0; col < COLS; col++) {
       // Check if the current cell is empty
-  
+      if (board[row][col] == EMPTY) {
         // Return false if the cell is empty
-  
-  
-  
-  
+        return false;
+      }
+    }
+  }
+
   // Return true if all cells are filled
-  
+  return true;
 }
@@ -1,18 +1,33 @@
 #ifndef __GAME_H__
 #define __GAME_H__
 
-#include "pico/multicore.h"
 #include "pico/stdlib.h"
+#if PICO_ON_DEVICE
+#include "pico/multicore.h"
+#else
+#include "hal_sim.h" // Host build: simulated multicore FIFO and GPIO levels
+#endif
 #include "pico/time.h"
 #include <stddef.h>
 #include <stdio.h>
 
+#ifndef ROWS
 #define ROWS 3                // Number of rows in table
+#endif
+#ifndef COLS
 #define COLS 3                // Number of col in table
+#endif
 #define EMPTY ' '             // Default value for empty cells
 #define X 'X'                 // Player 1 symbol
 #define O 'O'                 // Player 2 symbol
+#ifndef DEBOUNCE_DELAY
 #define DEBOUNCE_DELAY 200000 // Debouncing delay in microseconds
+#endif
+#define DEBOUNCE_TICK_US 1000 // Period the buttons are sampled at
+// Ticks a level must be kept for to count, at least 1 even when DEBOUNCE_DELAY
+// is 0 (host build), so a level is always read twice
+#define DEBOUNCE_TICKS                                                        \
+  (DEBOUNCE_DELAY >= DEBOUNCE_TICK_US ? DEBOUNCE_DELAY / DEBOUNCE_TICK_US : 1)
 #define BLINK_LED_DELAY 500   // Blink led delay in miliseconds
 #define HIGH 1
 #define LOW 0
@@ -36,14 +51,19 @@ typedef struct {
 // Struct for storing button state information
 // @field but_pin the number of the button pin
 // @field prev_state the previous state of the button
-// @field curr_state the current state of the button
+// @field curr_state the current state of the button, changes once the pin
+// level is stable
+// @field raw_state the level read at the last sample
+// @field stable_ticks number of samples the level has not changed for, up to
+// DEBOUNCE_TICKS
 typedef struct {
   uint but_pin;
   bool prev_state;
   bool curr_state;
+  bool raw_state;
+  uint stable_ticks;
 } BtnState;
 
-
 // ----------------------------------------
 // GPIO setting functions
 // ----------------------------------------
@@ -73,15 +93,15 @@ void init_gpio(GpioConfig *gpio, size_t len);
 bool debounce(const volatile BtnState btn);
 
 /**
- * @brief Returns whether the button state is stable or not
+ * @brief Returns whether the button state is stable or not, without waiting
  *
  * @param button Index of the button
- * @param prev_state Previous state of the button
+ * @param stable_ticks Number of samples the button level has not changed for
  *
- * @return true If the button state is stable
+ * @return true If the level has not changed for DEBOUNCE_DELAY
  * @return false If the button state is not stable
  */
-bool is_stable(const uint button, const bool prev_state);
+bool is_stable(const uint button, const uint stable_ticks);
 
 /**
  * @brief Returns whether the button state has changed or not
@@ -95,7 +115,7 @@ bool is_stable(const uint button, const bool prev_state);
 bool has_changed(bool prev_state, bool curr_state);
 
 /**
- * @brief Updates the button state
+ * @brief Samples the button, called every DEBOUNCE_TICK_US
  *
  * @param btn Pointer to the button state structure
  */
@@ -191,6 +211,16 @@ bool is_valid_pos(const uint row, const uint col);
  */
 bool is_empty_pos(uint const row, uint const col, const char (*board)[COLS]);
 
+/**
+ * @brief Enter the current player's move into the board, without printing.
+ *
+ * @param current_player The current player.
+ * @param moves The number of moves made.
+ * @param board The tic-tac-toe board.
+ */
+void place_piece(const char current_player, const uint moves,
+                 char (*board)[COLS]);
+
 /**
  * @brief Update the tic-tac-toe board with the current player's move.
  *
@@ -245,6 +275,24 @@ void handle_btn1(uint *moves);
 void handle_btn2(char *current_player, uint *moves, char (*board)[COLS],
                  bool *is_game_over);
 
+// Evaluator state kept next to a board, see eval.h
+struct EvalState;
+
+/**
+ * @brief Handle button 2 press on a board with an evaluator state.
+ *
+ * The move is placed into eval as well and a tie reset empties it, so eval
+ * must describe board when called.
+ *
+ * @param current_player The current player.
+ * @param moves The number of moves made.
+ * @param board The tic-tac-toe board.
+ * @param is_game_over Flag indicating if the game is over.
+ * @param eval The evaluator state of board, NULL to scan the board instead.
+ */
+void handle_btn2_eval(char *current_player, uint *moves, char (*board)[COLS],
+                      bool *is_game_over, struct EvalState *eval);
+
 // ----------------------------------------
 // Game status functions
 // ----------------------------------------
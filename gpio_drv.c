@@ -0,0 +1,115 @@
+#include "gpio_drv.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+
+// Cached value of the output pins listed in GPIO_PIN_TABLE
+static uint32_t out_cache = 0;
+// Driver statistics
+static GpioDrvStats stats;
+// Guards the cache, the statistics and the output register, both cores write
+// the LEDs through the driver
+static spin_lock_t *drv_lock = NULL;
+
+// ----------------------------------------
+// GPIO driver functions
+// ----------------------------------------
+
+/*
+The function gpio_drv_init initializes all pins of GPIO_PIN_TABLE with one call
+to gpio_init_mask and sets all their directions with one call to
+gpio_set_dir_masked. The output pins start LOW, which is also what the output
+cache starts with. It must run before core1 is launched, core1 blinks the LEDs
+through the driver.
+*/
+void gpio_drv_init(void) {
+  // Claim the lock shared by both cores
+  drv_lock = spin_lock_instance(spin_lock_claim_unused(true));
+
+  // Initialize every pin of the table at once
+  gpio_init_mask(GPIO_ALL_MASK);
+
+  // Drive the outputs LOW before they are switched to output mode
+  gpio_put_masked(GPIO_OUT_MASK, 0);
+  out_cache = 0;
+
+  // Set the direction of every pin of the table at once
+  gpio_set_dir_masked(GPIO_ALL_MASK, GPIO_OUT_MASK);
+
+  // Start the first statistics window
+  stats.window_start_us = time_us_64();
+}
+
+/*
+The function gpio_drv_put_masked computes the new output value from the cache.
+If none of the selected pins changes, nothing is written. Otherwise all of them
+are updated with a single masked write and the cache is refreshed. The number
+of gpio_put calls a per-pin implementation would have made is counted so the
+savings can be reported.
+Core0 and core1 both call it, so the cache always holds what the pins show; the
+spin lock makes the compare, the write and the cache update one step.
+*/
+void gpio_drv_put_masked(uint32_t mask, uint32_t value) {
+  // Only output pins of the table are managed by the driver
+  mask &= GPIO_OUT_MASK;
+
+  uint32_t irq = spin_lock_blocking(drv_lock);
+
+  // Count this request and the writes a per-pin driver would need
+  stats.put_calls++;
+  stats.naive_writes += __builtin_popcount(mask);
+
+  // Compute the new output value
+  uint32_t next = (out_cache & ~mask) | (value & mask);
+
+  // Update all selected pins with one register write, unless they already
+  // have the requested value
+  if (next != out_cache) {
+    gpio_put_masked(mask, value);
+    out_cache = next;
+    stats.reg_writes++;
+  }
+
+  spin_unlock(drv_lock, irq);
+}
+
+/*
+The function gpio_drv_get_out returns the cached output value.
+*/
+uint32_t gpio_drv_get_out(void) { return out_cache; }
+
+/*
+The function gpio_drv_get_stats copies the driver statistics.
+*/
+void gpio_drv_get_stats(GpioDrvStats *out) {
+  uint32_t irq = spin_lock_blocking(drv_lock);
+  *out = stats;
+  spin_unlock(drv_lock, irq);
+}
+
+/*
+The function gpio_drv_print_stats prints how many register writes the driver
+saved per second over the window since the previous call, then starts a new
+window.
+*/
+void gpio_drv_print_stats(void) {
+  // Take the counters and start a new window, core1 may be counting
+  uint32_t irq = spin_lock_blocking(drv_lock);
+  uint64_t now = time_us_64();
+  GpioDrvStats s = stats;
+  stats.window_start_us = now;
+  stats.window_saved = s.naive_writes - s.reg_writes;
+  spin_unlock(drv_lock, irq);
+
+  // Measure the window length
+  uint64_t elapsed_us = now - s.window_start_us;
+
+  // Writes saved since the driver started and during this window
+  uint32_t saved = s.naive_writes - s.reg_writes;
+  uint32_t window_saved = saved - s.window_saved;
+
+  if (elapsed_us > 0) {
+    printf("GPIO: %lu writes issued, %lu saved, %llu saved/s\n",
+           (unsigned long)s.reg_writes, (unsigned long)saved,
+           (unsigned long long)window_saved * 1000000ull / elapsed_us);
+  }
+}
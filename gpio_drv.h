@@ -0,0 +1,86 @@
+#ifndef __GPIO_DRV_H__
+#define __GPIO_DRV_H__
+
+#include "game.h"
+#include <stdint.h>
+
+// Compile-time table of every GPIO used by this project
+// Each entry is PIN(pin_number, pin_dir)
+#define GPIO_PIN_TABLE(PIN)                                                    \
+  PIN(LED1, GPIO_OUT)                                                          \
+  PIN(LED2, GPIO_OUT)                                                          \
+  PIN(BTN1, GPIO_IN)                                                           \
+  PIN(BTN2, GPIO_IN)                                                           \
+  PIN(BTN3, GPIO_IN)                                                           \
+  PIN(ONBOARD_LED, GPIO_OUT)
+
+// Helpers turning one table entry into a mask term
+#define GPIO_PIN_BIT(pin, dir) | (1u << (pin))
+#define GPIO_PIN_OUT_BIT(pin, dir) | ((dir) == GPIO_OUT ? (1u << (pin)) : 0u)
+
+// Masks built from the pin table at compile time
+#define GPIO_ALL_MASK (0u GPIO_PIN_TABLE(GPIO_PIN_BIT))
+#define GPIO_OUT_MASK (0u GPIO_PIN_TABLE(GPIO_PIN_OUT_BIT))
+#define GPIO_IN_MASK (GPIO_ALL_MASK & ~GPIO_OUT_MASK)
+
+// Mask of the two player LEDs
+#define PLAYER_LED_MASK ((1u << LED1) | (1u << LED2))
+
+// Struct for storing GPIO driver statistics
+// @field put_calls number of masked put requests
+// @field naive_writes writes a per-pin gpio_put implementation would issue
+// @field reg_writes register writes actually issued
+// @field window_start_us start of the current per-second measurement window
+// @field window_saved writes saved at the start of the window
+typedef struct {
+  uint32_t put_calls;
+  uint32_t naive_writes;
+  uint32_t reg_writes;
+  uint64_t window_start_us;
+  uint32_t window_saved;
+} GpioDrvStats;
+
+// ----------------------------------------
+// GPIO driver functions
+// ----------------------------------------
+
+/**
+ * @brief Initializes every pin in GPIO_PIN_TABLE and sets their direction
+ * through pin masks
+ *
+ * Must be called before core1 is launched.
+ */
+void gpio_drv_init(void);
+
+/**
+ * @brief Writes the output pins selected by mask only if their value changes
+ *
+ * Safe to call from both cores. Every write of an output pin of the table must
+ * go through the driver, or the cache no longer matches the pins.
+ *
+ * @param mask Pins to update
+ * @param value New value of the pins selected by mask
+ */
+void gpio_drv_put_masked(uint32_t mask, uint32_t value);
+
+/**
+ * @brief Returns the cached output value of the pins
+ *
+ * @return The cached output register value
+ */
+uint32_t gpio_drv_get_out(void);
+
+/**
+ * @brief Copies the driver statistics
+ *
+ * @param stats Pointer to the structure receiving the statistics
+ */
+void gpio_drv_get_stats(GpioDrvStats *stats);
+
+/**
+ * @brief Prints the number of register writes saved per second since the
+ * previous call and starts a new measurement window
+ */
+void gpio_drv_print_stats(void);
+
+#endif
@@ -0,0 +1,96 @@
+#include "hal_sim.h"
+#include "hardware/gpio.h"
+
+// Input level of each pin, set by the host tool
+static uint32_t sim_inputs = 0;
+// Output level of each pin, set by the game
+static uint32_t sim_outputs = 0;
+// Simulated inter-core FIFO
+static uint32_t sim_fifo[HAL_SIM_FIFO_DEPTH];
+static uint sim_fifo_head = 0;
+static uint sim_fifo_count = 0;
+static uint32_t sim_fifo_drops = 0;
+
+// ----------------------------------------
+// Multicore functions
+// ----------------------------------------
+
+/*
+The function multicore_launch_core1 does nothing on the host. Core1 only
+consumes the FIFO, which host tools can do themselves.
+*/
+void multicore_launch_core1(void (*entry)(void)) { (void)entry; }
+
+/*
+The function multicore_fifo_push_blocking appends data to the FIFO. When the
+FIFO is full the oldest value is dropped and counted.
+*/
+void multicore_fifo_push_blocking(uint32_t data) {
+  // Drop the oldest value if the FIFO is full
+  if (sim_fifo_count == HAL_SIM_FIFO_DEPTH) {
+    sim_fifo_head = (sim_fifo_head + 1) % HAL_SIM_FIFO_DEPTH;
+    sim_fifo_count--;
+    sim_fifo_drops++;
+  }
+
+  // Append the value
+  sim_fifo[(sim_fifo_head + sim_fifo_count) % HAL_SIM_FIFO_DEPTH] = data;
+  sim_fifo_count++;
+}
+
+/*
+The function multicore_fifo_pop_blocking removes the oldest value of the FIFO.
+It returns 0 instead of blocking when the FIFO is empty.
+*/
+uint32_t multicore_fifo_pop_blocking(void) {
+  if (sim_fifo_count == 0) {
+    return 0;
+  }
+
+  uint32_t data = sim_fifo[sim_fifo_head];
+  sim_fifo_head = (sim_fifo_head + 1) % HAL_SIM_FIFO_DEPTH;
+  sim_fifo_count--;
+  return data;
+}
+
+/*
+The function multicore_fifo_rvalid returns true if the FIFO is not empty.
+*/
+bool multicore_fifo_rvalid(void) { return sim_fifo_count > 0; }
+
+// ----------------------------------------
+// GPIO functions
+// ----------------------------------------
+// These replace the empty weak GPIO stubs of the SDK host platform.
+
+bool gpio_get(uint gpio) { return (sim_inputs >> gpio) & 1u; }
+
+void gpio_put(uint gpio, bool value) {
+  sim_outputs = value ? sim_outputs | (1u << gpio) : sim_outputs & ~(1u << gpio);
+}
+
+void gpio_put_masked(uint32_t mask, uint32_t value) {
+  sim_outputs = (sim_outputs & ~mask) | (value & mask);
+}
+
+bool gpio_get_out_level(uint gpio) { return (sim_outputs >> gpio) & 1u; }
+
+// ----------------------------------------
+// Simulation control functions
+// ----------------------------------------
+
+void hal_sim_set_input(uint pin, bool level) {
+  sim_inputs = level ? sim_inputs | (1u << pin) : sim_inputs & ~(1u << pin);
+}
+
+uint32_t hal_sim_get_outputs(void) { return sim_outputs; }
+
+uint32_t hal_sim_fifo_dropped(void) { return sim_fifo_drops; }
+
+void hal_sim_reset(void) {
+  sim_inputs = 0;
+  sim_outputs = 0;
+  sim_fifo_head = 0;
+  sim_fifo_count = 0;
+  sim_fifo_drops = 0;
+}
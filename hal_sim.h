@@ -0,0 +1,82 @@
+#ifndef __HAL_SIM_H__
+#define __HAL_SIM_H__
+
+// Simulated hardware for host builds (cmake -DPICO_PLATFORM=host)
+// The Pico SDK host platform has no pico_multicore and its GPIO functions are
+// empty stubs. This layer provides the multicore FIFO used by the game and
+// keeps GPIO input and output levels in memory so host tools can drive the
+// buttons and observe the LEDs.
+
+#include "pico/stdlib.h"
+#include <stdint.h>
+
+#define HAL_SIM_FIFO_DEPTH 8 // Same depth as the RP2040 inter-core FIFO
+
+// ----------------------------------------
+// Multicore functions
+// ----------------------------------------
+
+/**
+ * @brief Records the core1 entry point; core1 code is not run on the host
+ *
+ * @param entry The core1 entry point
+ */
+void multicore_launch_core1(void (*entry)(void));
+
+/**
+ * @brief Pushes a value into the simulated inter-core FIFO
+ *
+ * There is no core1 draining the FIFO on the host, so when it is full the
+ * oldest value is dropped instead of blocking.
+ *
+ * @param data The value to push
+ */
+void multicore_fifo_push_blocking(uint32_t data);
+
+/**
+ * @brief Pops a value from the simulated inter-core FIFO
+ *
+ * @return The oldest value, or 0 if the FIFO is empty.
+ */
+uint32_t multicore_fifo_pop_blocking(void);
+
+/**
+ * @brief Returns whether the simulated FIFO holds data
+ *
+ * @return true If a value can be popped
+ * @return false If the FIFO is empty
+ */
+bool multicore_fifo_rvalid(void);
+
+// ----------------------------------------
+// Simulation control functions
+// ----------------------------------------
+
+/**
+ * @brief Sets the level seen by gpio_get on a pin
+ *
+ * @param pin The number of the pin
+ * @param level The input level
+ */
+void hal_sim_set_input(uint pin, bool level);
+
+/**
+ * @brief Returns the output levels of all pins
+ *
+ * @return One bit per pin, set when the pin drives HIGH
+ */
+uint32_t hal_sim_get_outputs(void);
+
+/**
+ * @brief Returns the number of values dropped because the FIFO was full
+ *
+ * @return The number of dropped values
+ */
+uint32_t hal_sim_fifo_dropped(void);
+
+/**
+ * @brief Empties the FIFO and sets every input and output LOW
+ */
+void hal_sim_reset(void);
+
+#endif
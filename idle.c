@@ -0,0 +1,244 @@
+#include "idle.h"
+#include "gpio_drv.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+
+// Power state of core0, read by core1 to decide whether it may park
+static volatile IdleState idle_state = IDLE_STATE_ACTIVE;
+// Set by the GPIO interrupt when a button edge is seen during sleep
+static volatile bool wake_edge = false;
+// Time stamp of the last handled button event
+static uint64_t last_activity_us = 0;
+// Time stamp of the last state transition of core0
+static uint64_t state_entered_us = 0;
+// Time stamp of the last wake up, 0 when no latency measurement is pending
+static uint64_t wake_us = 0;
+// Instrumentation counters
+static IdleStats stats;
+// Guards stats.core1_parked_us, written by core1 and copied by core0
+static spin_lock_t *parked_lock = NULL;
+// Set by core1 while it is parked in idle_core1_wait
+static volatile bool core1_parked = false;
+
+// ----------------------------------------
+// Internal helpers
+// ----------------------------------------
+
+/*
+The function idle_set_state moves core0 to a new power state. The time spent in
+the previous state is added to the matching time_in_state_us counter before the
+new state is published to core1.
+*/
+static void idle_set_state(IdleState new_state) {
+  // Get the time of the transition
+  uint64_t now = time_us_64();
+
+  // Account the time spent in the state we are leaving
+  stats.time_in_state_us[idle_state] += now - state_entered_us;
+  state_entered_us = now;
+
+  // Publish the new state to core1
+  idle_state = new_state;
+  __dmb();
+}
+
+/*
+The function idle_gpio_callback runs in interrupt context on core0 whenever one
+of the buttons sees a rising edge. It only raises the wake_edge flag; the main
+loop does the actual button handling after the WFI returns.
+*/
+static void idle_gpio_callback(uint gpio, uint32_t events) {
+  // Only the button pins are registered, any edge means "wake up"
+  if (((1u << gpio) & IDLE_WAKE_MASK) && (events & GPIO_IRQ_EDGE_RISE)) {
+    wake_edge = true;
+  }
+}
+
+// ----------------------------------------
+// Idle manager functions
+// ----------------------------------------
+
+/*
+The function idle_init resets the instrumentation and registers a rising edge
+interrupt on BTN1, BTN2 and BTN3. The interrupt stays enabled all the time; its
+handler is cheap and only matters while core0 sleeps. It also claims the spin
+lock that guards the time core1 spends parked.
+*/
+void idle_init(void) {
+  // Start the inactivity timer and the state accounting from now
+  last_activity_us = time_us_64();
+  state_entered_us = last_activity_us;
+  idle_state = IDLE_STATE_ACTIVE;
+
+  // A 64-bit counter cannot be copied atomically on the Cortex-M0+
+  parked_lock = spin_lock_instance(spin_lock_claim_unused(true));
+
+  // Register the wake interrupt for each button
+  gpio_set_irq_enabled_with_callback(BTN1, GPIO_IRQ_EDGE_RISE, true,
+                                     &idle_gpio_callback);
+  gpio_set_irq_enabled(BTN2, GPIO_IRQ_EDGE_RISE, true);
+  gpio_set_irq_enabled(BTN3, GPIO_IRQ_EDGE_RISE, true);
+}
+
+/*
+The function idle_note_activity restarts the inactivity timer. If the board has
+just woken up, the time between the wake up and this first handled event is
+recorded as the wake-to-first-event latency.
+*/
+void idle_note_activity(void) {
+  // Restart the inactivity timer
+  last_activity_us = time_us_64();
+
+  // Close the pending wake latency measurement, if any
+  if (wake_us != 0) {
+    uint64_t latency = last_activity_us - wake_us;
+    stats.wake_latency_samples++;
+    stats.wake_latency_total_us += latency;
+    if (latency > stats.wake_latency_max_us) {
+      stats.wake_latency_max_us = latency;
+    }
+    wake_us = 0;
+  }
+}
+
+/*
+The function idle_poll checks the inactivity timer. When it has expired, core0
+enters the sleep state and waits for core1 to park, since core1 may be in the
+middle of a blink and would switch its LED on again. Then the LEDs are switched
+off and core0 waits in WFI until a button edge is seen. Other interrupts (USB,
+timers) also return from WFI; those are counted as spurious wakes and core0
+goes straight back to sleep. On wake up the LED outputs are restored and core1
+is released with SEV.
+The flag is checked with interrupts disabled: an edge that arrives between the
+check and the WFI stays pending, and a pending interrupt ends the WFI even
+while it is masked, so the edge cannot be missed. Interrupts are enabled again
+after every WFI to let the handler run.
+*/
+void idle_poll(void) {
+  // Nothing to do while the board is in use
+  if (time_us_64() - last_activity_us < IDLE_TIMEOUT_US) {
+    return;
+  }
+
+#ifdef VERBOSE
+  printf("Idle for %d s, going to sleep\n", IDLE_TIMEOUT_US / 1000000);
+#endif
+
+  // Enter the sleep state
+  wake_edge = false;
+  stats.sleep_count++;
+  idle_set_state(IDLE_STATE_SLEEP);
+
+  // Wait for core1 to finish its blink and park, a button edge cancels
+  uint64_t park_start_us = time_us_64();
+  while (!core1_parked && !wake_edge &&
+         time_us_64() - park_start_us < IDLE_PARK_WAIT_US) {
+    __wfe();
+  }
+
+  // Save the LED outputs and switch the LEDs off
+  uint32_t saved_out = gpio_drv_get_out() & IDLE_LED_MASK;
+  gpio_drv_put_masked(IDLE_LED_MASK, 0);
+
+  // Wait for a button edge, ignore every other interrupt
+  uint32_t irq = save_and_disable_interrupts();
+  while (!wake_edge) {
+    __wfi();
+    restore_interrupts(irq);
+    irq = save_and_disable_interrupts();
+    if (!wake_edge) {
+      stats.spurious_wakes++;
+    }
+  }
+  restore_interrupts(irq);
+
+  // Back to the active state, start the wake latency measurement
+  idle_set_state(IDLE_STATE_ACTIVE);
+  wake_us = state_entered_us;
+  last_activity_us = wake_us;
+
+  // Restore the LED outputs and release core1
+  gpio_drv_put_masked(IDLE_LED_MASK, saved_out);
+  __sev();
+
+#ifdef VERBOSE
+  idle_print_stats();
+#endif
+}
+
+/*
+The function idle_core1_wait is called by core1 at the top of its loop. While
+core0 sleeps and no winner is waiting in the multicore FIFO, core1 parks in
+WFE. It raises core1_parked with SEV first, which lets core0 switch the LEDs
+off. Core0 issues SEV on wake up and a FIFO push also generates an event, so
+either one releases core1.
+*/
+void idle_core1_wait(void) {
+  // Nothing to do while core0 is active
+  if (idle_state != IDLE_STATE_SLEEP) {
+    return;
+  }
+
+  // Tell core0 that no LED changes anymore
+  core1_parked = true;
+  __dmb();
+  __sev();
+
+  // Park until core0 wakes up or a value is pushed into the FIFO
+  uint64_t parked_us = time_us_64();
+  while (idle_state == IDLE_STATE_SLEEP && !multicore_fifo_rvalid()) {
+    __wfe();
+  }
+  parked_us = time_us_64() - parked_us;
+  core1_parked = false;
+
+  // Core0 may be copying the counter
+  uint32_t irq = spin_lock_blocking(parked_lock);
+  stats.core1_parked_us += parked_us;
+  spin_unlock(parked_lock, irq);
+}
+
+/*
+The function idle_get_state returns the current power state of core0.
+*/
+IdleState idle_get_state(void) { return idle_state; }
+
+/*
+The function idle_get_stats copies the instrumentation counters. The time spent
+in the current state up to now is included in the copy. The time core1 was
+parked is copied under the spin lock, core1 may be adding to it.
+*/
+void idle_get_stats(IdleStats *out) {
+  // Copy the counters
+  *out = stats;
+  if (parked_lock != NULL) {
+    uint32_t irq = spin_lock_blocking(parked_lock);
+    out->core1_parked_us = stats.core1_parked_us;
+    spin_unlock(parked_lock, irq);
+  }
+
+  // Add the time spent in the current state so far
+  out->time_in_state_us[idle_state] += time_us_64() - state_entered_us;
+}
+
+/*
+The function idle_print_stats prints the time spent by core0 in each state, the
+time core1 was parked and the average and worst wake-to-first-event latency.
+*/
+void idle_print_stats(void) {
+  IdleStats s;
+  idle_get_stats(&s);
+
+  printf("Idle: active %llu ms, sleep %llu ms, core1 parked %llu ms\n",
+         (unsigned long long)s.time_in_state_us[IDLE_STATE_ACTIVE] / 1000,
+         (unsigned long long)s.time_in_state_us[IDLE_STATE_SLEEP] / 1000,
+         (unsigned long long)s.core1_parked_us / 1000);
+  printf("Idle: %lu sleeps, %lu spurious wakes\n", (unsigned long)s.sleep_count,
+         (unsigned long)s.spurious_wakes);
+  if (s.wake_latency_samples > 0) {
+    printf("Idle: wake to first event avg %llu us, max %llu us\n",
+           (unsigned long long)(s.wake_latency_total_us /
+                                s.wake_latency_samples),
+           (unsigned long long)s.wake_latency_max_us);
+  }
+}
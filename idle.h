@@ -0,0 +1,95 @@
+#ifndef __IDLE_H__
+#define __IDLE_H__
+
+#include "game.h"
+#include <stdint.h>
+
+#define IDLE_TIMEOUT_US 30000000 // Inactivity before core0 sleeps (microseconds)
+// Longest wait for core1 to finish a blink and park before the LEDs go off
+#define IDLE_PARK_WAIT_US (2 * BLINK_LED_DELAY * 1000 + 10000)
+
+// Mask of the button pins that are allowed to wake core0 from sleep
+#define IDLE_WAKE_MASK ((1u << BTN1) | (1u << BTN2) | (1u << BTN3))
+
+// Mask of the LED pins that are switched off while the board sleeps
+#define IDLE_LED_MASK ((1u << LED1) | (1u << LED2) | (1u << ONBOARD_LED))
+
+// Power states tracked by the idle manager
+typedef enum {
+  IDLE_STATE_ACTIVE, // Core0 is polling the buttons
+  IDLE_STATE_SLEEP,  // Core0 waits in WFI for a button edge
+  IDLE_STATE_COUNT
+} IdleState;
+
+// Struct for storing idle manager instrumentation
+// @field time_in_state_us accumulated time spent by core0 in each state
+// @field core1_parked_us accumulated time core1 spent parked in WFE
+// @field sleep_count number of times core0 entered the sleep state
+// @field spurious_wakes number of WFI returns that were not a button edge
+// @field wake_latency_samples number of wake-to-first-event measurements
+// @field wake_latency_total_us sum of all wake-to-first-event latencies
+// @field wake_latency_max_us worst wake-to-first-event latency
+typedef struct {
+  uint64_t time_in_state_us[IDLE_STATE_COUNT];
+  uint64_t core1_parked_us;
+  uint32_t sleep_count;
+  uint32_t spurious_wakes;
+  uint32_t wake_latency_samples;
+  uint64_t wake_latency_total_us;
+  uint64_t wake_latency_max_us;
+} IdleStats;
+
+// ----------------------------------------
+// Idle manager functions
+// ----------------------------------------
+
+/**
+ * @brief Initializes the idle manager and enables the button wake interrupts
+ *
+ * Must be called after the button GPIOs have been configured as inputs.
+ */
+void idle_init(void);
+
+/**
+ * @brief Records user activity and closes a pending wake latency measurement
+ *
+ * Call this every time a debounced button event is handled.
+ */
+void idle_note_activity(void);
+
+/**
+ * @brief Puts core0 to sleep when the inactivity timeout has expired
+ *
+ * Call this once per main loop iteration. Returns immediately while the board
+ * is in use; otherwise it blocks until a button edge wakes the board up.
+ */
+void idle_poll(void);
+
+/**
+ * @brief Parks core1 in WFE while core0 is asleep
+ *
+ * Core1 is released when core0 wakes up or when data arrives in the
+ * multicore FIFO.
+ */
+void idle_core1_wait(void);
+
+/**
+ * @brief Returns the current power state of core0
+ *
+ * @return The current idle state.
+ */
+IdleState idle_get_state(void);
+
+/**
+ * @brief Copies the idle manager instrumentation
+ *
+ * @param stats Pointer to the structure receiving the statistics
+ */
+void idle_get_stats(IdleStats *stats);
+
+/**
+ * @brief Prints the time spent in each state and the wake latency figures
+ */
+void idle_print_stats(void);
+
+#endif
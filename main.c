@@ -1,87 +1,349 @@
 #include "game.h"
+#include "bitboard.h"
+#include "engine_async.h"
+#include "eval.h"
+#include "gpio_drv.h"
+#include "idle.h"
+#include "scheduler.h"
+#ifdef ULTIMATE
+#include "ultimate.h"
+#endif
+
+// Periods, deadlines and budgets of the main loop tasks (microseconds)
+// The buttons are debounced by counting samples, one per input period, so the
+// input task never waits and its budget covers sampling only. A press prints
+// the board, so it is handled by the press task, with its own budget.
+#define INPUT_PERIOD_US DEBOUNCE_TICK_US
+#define INPUT_DEADLINE_US 500
+#define INPUT_BUDGET_US 20
+#define PRESS_DEADLINE_US 10000
+#define PRESS_BUDGET_US 2000
+#define RENDER_PERIOD_US 20000
+#define RENDER_BUDGET_US 200
+#define ENGINE_PERIOD_US 5000
+#define ENGINE_BUDGET_US 2000
+#define STATS_PERIOD_US 1000000
+
+// Bits of the presses waiting for the press task
+#define PRESS_BTN1 (1u << 0)
+#define PRESS_BTN2 (1u << 1)
+#define PRESS_BTN3 (1u << 2)
+
+// Struct for storing the game state shared by the main loop tasks
+// @field board the tic-tac-toe board (classic game)
+// @field moves the cursor position (classic game)
+// @field eval window counts, threats and score of board, kept by
+// handle_btn2_eval (classic game)
+// @field hinted position the last hint was shown for (classic game)
+// @field current_player the player to move
+// @field is_game_over true once a player has won
+// @field engine_turn true while the engine on core1 chooses the next move
+// @field btn1 button 1 state
+// @field btn2 button 2 state
+// @field btn3 button 3 state
+// @field presses debounced presses waiting for the press task (PRESS_BTN*)
+typedef struct {
+#ifndef ULTIMATE
+  char board[ROWS][COLS];
+  uint moves;
+  EvalState eval;
+  Bitboard hinted;
+#endif
+  char current_player;
+  bool is_game_over;
+  bool engine_turn;
+  volatile BtnState btn1;
+  volatile BtnState btn2;
+  volatile BtnState btn3;
+  uint8_t presses;
+} Game;
+
+static Game game = {
+#ifndef ULTIMATE
+    // The board of any ROWS x COLS size is emptied by reset_board in main
+    // Set current number of moves initialized to 0
+    .moves = 0,
+#endif
+    // Set current player to X
+    .current_player = X,
+    .is_game_over = false,
+    .engine_turn = false,
+    // Button states
+    .btn1 = {.but_pin = BTN1, .prev_state = false, .curr_state = false},
+    .btn2 = {.but_pin = BTN2, .prev_state = false, .curr_state = false},
+    .btn3 = {.but_pin = BTN3, .prev_state = false, .curr_state = false},
+    .presses = 0,
+};
+
+#ifdef ULTIMATE
+// Ultimate board, the engine's search tree lives on core1
+static UltBoard ult_board;
+#endif
+
+// Player moved by the engine on core1 and its thinking time
+#ifdef ULTIMATE
+#define GAME_ENGINE_PLAYER ULT_ENGINE_PLAYER
+#define GAME_ENGINE_US ULT_ENGINE_US
+#else
+#define GAME_ENGINE_PLAYER ENGINE_PLAYER
+#define GAME_ENGINE_US ENGINE_US
+#endif
+
+// Ids of the tasks triggered by other tasks
+static int press_task = SCHED_NONE;
+static int render_task = SCHED_NONE;
+static int engine_task = SCHED_NONE;
+
+// ----------------------------------------
+// Main loop tasks
+// ----------------------------------------
+
+/*
+The function game_sync copies the player to move and the winner from the
+ultimate board, which keeps them itself. The classic game updates them in
+handle_btn2 directly.
+*/
+static void game_sync(Game *g) {
+#ifdef ULTIMATE
+  g->current_player = ult_board.to_move;
+  g->is_game_over = ult_board.winner != 0;
+#else
+  (void)g;
+#endif
+}
+
+/*
+The function task_input samples the three buttons and hands the debounced
+presses to the press task, which it triggers right away.
+*/
+static void task_input(void *ctx) {
+  Game *g = ctx;
+  game_sync(g);
+  // Measure how long the buttons went unsampled while core1 searches
+  engine_async_note_loop();
+
+  if (!g->is_game_over) {
+    // Update button 1 state
+    update_btn_state(&g->btn1);
+    // Check if button 1 was pressed and debounced
+    if (debounce(g->btn1) && !g->engine_turn) {
+      g->presses |= PRESS_BTN1;
+    }
+    // Update button 2 state
+    update_btn_state(&g->btn2);
+    // Check if button 2 was pressed and debounced
+    if (debounce(g->btn2) && !g->engine_turn) {
+      g->presses |= PRESS_BTN2;
+    }
+  }
+  // Update button 3 state
+  update_btn_state(&g->btn3);
+  // Check if button 3 was pressed and debounced
+  if (debounce(g->btn3)) {
+    g->presses |= PRESS_BTN3;
+  }
+
+  if (g->presses != 0) {
+    sched_trigger(press_task);
+  }
+}
+
+/*
+The function task_press handles the presses found by the input task, in button
+order. Presses change the board, so the render and engine tasks are triggered
+right away instead of at their next period.
+*/
+static void task_press(void *ctx) {
+  Game *g = ctx;
+  game_sync(g);
+  uint8_t presses = g->presses;
+  g->presses = 0;
+
+  if (!g->is_game_over) {
+    if (presses & PRESS_BTN1) {
+      // Handle button 1 press event
+#ifdef ULTIMATE
+      ult_handle_btn1(&ult_board);
+#else
+      handle_btn1(&g->moves);
+#endif
+      idle_note_activity();
+    }
+    if (presses & PRESS_BTN2) {
+      // Handle button 2 press event
+#ifdef ULTIMATE
+      ult_handle_btn2(&ult_board);
+#else
+      handle_btn2_eval(&g->current_player, &g->moves, g->board,
+                       &g->is_game_over, &g->eval);
+#endif
+      idle_note_activity();
+      sched_trigger(render_task);
+      sched_trigger(engine_task);
+    }
+  }
+  if (presses & PRESS_BTN3) {
+    // Stop the search of the position being reset
+    engine_async_cancel();
+    // Handle button 3 press event
+#ifdef ULTIMATE
+    ult_reset(&ult_board);
+#else
+    reset_board(&g->current_player, &g->moves, g->board, &g->is_game_over);
+    eval_clear(&g->eval);
+#endif
+    idle_note_activity();
+    sched_trigger(render_task);
+  }
+}
+
+/*
+The function task_render shows the player to move on the player LEDs. In the
+classic game it also prints once per position where the player to move can
+win, or must block, from the threats kept by the evaluator.
+*/
+static void task_render(void *ctx) {
+  Game *g = ctx;
+  game_sync(g);
+
+  // Update player status led
+  if (!g->is_game_over) {
+    update_player_led(g->current_player);
+  }
+#ifndef ULTIMATE
+  // Show the hint of a new position
+  if (g->eval.bb.x != g->hinted.x || g->eval.bb.o != g->hinted.o) {
+    g->hinted = g->eval.bb;
+    if (!g->is_game_over) {
+      eval_print_hint(&g->eval, g->current_player);
+    }
+  }
+#endif
+}
+
+/*
+The function task_engine posts the position to core1 on the engine's turn and
+plays the move once the search is done, or at once when the position is in the
+opening book. The buttons keep being sampled by the input task meanwhile. The
+classic game plays the move as a BTN2 press on its cell.
+*/
+static void task_engine(void *ctx) {
+  Game *g = ctx;
+  game_sync(g);
+
+  // Post the position on the engine's turn
+  g->engine_turn = GAME_ENGINE_PLAYER && !g->is_game_over &&
+                   g->current_player == GAME_ENGINE_PLAYER;
+  if (g->engine_turn && !engine_async_busy()) {
+    printf("Player %c is thinking ...\n", g->current_player);
+#ifdef ULTIMATE
+    engine_async_post(&ult_board, GAME_ENGINE_US);
+#else
+    EnginePosition position = {.board = g->eval.bb,
+                               .to_move = g->current_player};
+    engine_async_post(&position, GAME_ENGINE_US);
+#endif
+  }
+
+  // Play the move of a finished search
+  EngineResult result;
+  if (engine_async_poll(&result) && result.move >= 0) {
+#ifdef ULTIMATE
+    ult_engine_move(&ult_board, result.move);
+#else
+    g->moves = result.move;
+    handle_btn2_eval(&g->current_player, &g->moves, g->board,
+                     &g->is_game_over, &g->eval);
+#endif
+    g->engine_turn = false;
+    idle_note_activity();
+    sched_trigger(render_task);
+  }
+}
+
+#ifdef VERBOSE
+/*
+The function task_stats reports the register writes saved by the GPIO driver,
+the engine responsiveness and the task accounting, and in the classic game the
+evaluation of the board for the player to move.
+*/
+static void task_stats(void *ctx) {
+  Game *g = ctx;
+  gpio_drv_print_stats();
+  engine_async_print_stats();
+  sched_print_stats();
+#ifdef ULTIMATE
+  (void)g;
+#else
+  printf("Eval: %ld for %c\n", (long)eval_score(&g->eval, g->current_player),
+         g->current_player);
+#endif
+}
+#endif
+
+/*
+The function task_idle lets the idle manager put core0 to sleep when nobody is
+playing. The time asleep is on purpose, so the periodic releases are moved to
+the wake up time instead of being counted as missed deadlines.
+*/
+static void task_idle(void *ctx) {
+  (void)ctx;
+  IdleStats before;
+  IdleStats after;
+
+  // Sleep until the next button press if nobody is playing
+  idle_get_stats(&before);
+  idle_poll();
+  idle_get_stats(&after);
+  if (after.sleep_count != before.sleep_count) {
+    sched_resync();
+  }
+}
 
-#define NUMBER_OF_GPIOS 6 // Number of GPIOs used in this project
 // Main function
 int main() {
-  //  initializes a 2D array board with dimensions ROWS x COLS with all elements
-  //  set to the constant EMPTY.
-  char board[ROWS][COLS] = {
-      {EMPTY, EMPTY, EMPTY}, 
-      {EMPTY, EMPTY, EMPTY}, 
-      {EMPTY, EMPTY, EMPTY}};
-
-  // Set current player to X
-  char current_player = X;
-  // Set current number of moves initialized to 0
-  uint moves = 0;
-
-  bool is_game_over = false;
-  // Array of structs of GPIO configurations
-  GpioConfig my_gpio[NUMBER_OF_GPIOS] = {{LED1, GPIO_OUT},
-                                         {LED2, GPIO_OUT},
-                                         {BTN1, GPIO_IN},
-                                         {BTN2, GPIO_IN},
-                                         {BTN3, GPIO_IN},
-                                         {ONBOARD_LED, GPIO_OUT},
-                                         };
-
-  // Struct for button 1 state
-  volatile BtnState btn1 = {
-      .but_pin = BTN1,
-      .prev_state = false,
-      .curr_state = false,
-  };
-
-  // Struct for button 2 state
-  volatile BtnState btn2 = {
-      .but_pin = BTN2,
-      .prev_state = false,
-      .curr_state = false,
-  };
-
-  // Struct for button 3 state
-  volatile BtnState btn3 = {
-      .but_pin = BTN3,
-      .prev_state = false,
-      .curr_state = false,
-  };
-
   // Initialize the standard input/output library
   stdio_init_all();
+  // Build the winning window tables used by the engine
+  bb_init();
+  // Empty the engine mailbox before core1 starts serving it
+  engine_async_init();
+  // Set GPIOs for our program (pins are listed in GPIO_PIN_TABLE), core1
+  // blinks the LEDs through the driver
+  gpio_drv_init();
   multicore_launch_core1(flash_winner_led);
-  // Set GPIOs for our program
-  init_gpio(my_gpio, NUMBER_OF_GPIOS);
-  // Reset the board for Tic-Tac-Toe game.
-  reset_board(&current_player, &moves, board, &is_game_over);
-
-  while (true) {
-
-    // Update player status led
-    if (!is_game_over) {
-      update_player_led(current_player);
-      // Update button 1 state
-      update_btn_state(&btn1);
-      // Check if button 1 was pressed and debounced
-      if (debounce(btn1)) {
-        // Handle button 1 press event
-        handle_btn1(&moves);
-      }
-      // Update button 2 state
-      update_btn_state(&btn2);
-      // Check if button 2 was pressed and debounced
-      if (debounce(btn2)) {
-        // Handle button 2 press event
-        handle_btn2(&current_player, &moves, board, &is_game_over);
-      }
-    }
-    // Update button 3 state
-    update_btn_state(&btn3);
-    // Check if button 3 was pressed and debounced
-    if (debounce(btn3)) {
-      // Handle button 3 press event
-      reset_board(&current_player, &moves, board, &is_game_over);
-    }
-  }
+  // Enable the button wake interrupts used by the idle manager
+  idle_init();
+#ifdef ULTIMATE
+  // Build the sub-board win lookup and reset the ultimate board
+  ult_init();
+  ult_reset(&ult_board);
+#else
+  // Build the evaluator tables
+  eval_init();
+  // Reset the board for Tic-Tac-Toe game and its evaluator
+  reset_board(&game.current_player, &game.moves, game.board,
+              &game.is_game_over);
+  eval_clear(&game.eval);
+#endif
+
+  // Register the main loop tasks
+  sched_init();
+  sched_add("input", task_input, &game, INPUT_PERIOD_US, INPUT_DEADLINE_US,
+            INPUT_BUDGET_US);
+  press_task = sched_add("press", task_press, &game, 0, PRESS_DEADLINE_US,
+                         PRESS_BUDGET_US);
+  render_task = sched_add("render", task_render, &game, RENDER_PERIOD_US,
+                          RENDER_PERIOD_US, RENDER_BUDGET_US);
+  engine_task = sched_add("engine", task_engine, &game, ENGINE_PERIOD_US,
+                          ENGINE_PERIOD_US, ENGINE_BUDGET_US);
+#ifdef VERBOSE
+  sched_add("stats", task_stats, &game, STATS_PERIOD_US, STATS_PERIOD_US, 0);
+#endif
+  sched_set_idle(sched_add("idle", task_idle, NULL, 0, 0, 0));
+
+  // Run the tasks forever
+  sched_run();
 
   return 0;
-}
\ No newline at end of file
+}
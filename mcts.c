@@ -0,0 +1,416 @@
+#include "mcts.h"
+#include "eval.h"
+
+// ----------------------------------------
+// Internal helpers
+// ----------------------------------------
+
+/*
+The function mcts_opponent returns the other player.
+*/
+static inline char mcts_opponent(const char player) {
+  return player == X ? O : X;
+}
+
+/*
+The function mcts_rand is a xorshift32 generator. It only uses integer
+operations so a given seed produces the same search on the RP2040 and on the
+host.
+*/
+static inline uint32_t mcts_rand(MctsTree *tree) {
+  uint32_t r = tree->rng;
+  r ^= r << 13;
+  r ^= r >> 17;
+  r ^= r << 5;
+  tree->rng = r;
+  return r;
+}
+
+/*
+The function mcts_pick returns the index of a random set bit of mask. Mask must
+not be 0.
+*/
+static uint mcts_pick(MctsTree *tree, BbMask mask) {
+  // Choose which of the set bits to return
+  uint skip = mcts_rand(tree) % __builtin_popcountll(mask);
+
+  // Clear the lowest set bits until the chosen one is the lowest
+  while (skip--) {
+    mask &= mask - 1;
+  }
+  return __builtin_ctzll(mask);
+}
+
+/*
+The function mcts_isqrt returns the integer square root of value.
+*/
+static uint32_t mcts_isqrt(uint32_t value) {
+  uint32_t root = 0;
+  uint32_t bit = 1u << 30;
+
+  // Find the highest power of four not above value
+  while (bit > value) {
+    bit >>= 2;
+  }
+
+  // Compute one bit of the result per step
+  while (bit != 0) {
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+/*
+The function mcts_ln_q16 approximates the natural logarithm of value (value >
+0) in Q16.16. The integer part of log2 comes from the highest set bit and the
+fraction is interpolated linearly between powers of two, then the result is
+scaled by ln(2).
+*/
+static uint32_t mcts_ln_q16(const uint32_t value) {
+  // Integer part of log2
+  uint32_t ip = 31 - __builtin_clz(value);
+
+  // Linear fraction between 2^ip and 2^(ip + 1)
+  uint32_t frac = ip >= 16 ? (value >> (ip - 16)) & 0xFFFF
+                           : (value << (16 - ip)) & 0xFFFF;
+
+  // log2 in Q16.16 times ln(2) in Q16.16
+  return (uint32_t)(((uint64_t)(ip << 16 | frac) * 45426u) >> 16);
+}
+
+/*
+The function mcts_score converts a game result to half points for player: 2
+for a win, 1 for a draw and 0 for a loss.
+*/
+static inline uint32_t mcts_score(const char winner, const char player) {
+  return winner == player ? 2 : winner == EMPTY ? 1 : 0;
+}
+
+/*
+The function mcts_winner returns the winner of the position after player
+moved: player if it completed a window, EMPTY if the board is full and 0 if
+the game goes on.
+*/
+static char mcts_winner(const EvalState *state, const char player) {
+  if (eval_is_win(state, player)) {
+    return player;
+  }
+  return state->filled == BB_CELLS ? EMPTY : 0;
+}
+
+/*
+The function mcts_new_node takes the next node from the pool and links it as
+the first child of parent. The node starts with every empty cell as an untried
+move unless the game is over.
+*/
+static uint16_t mcts_new_node(MctsTree *tree, const uint16_t parent,
+                              const uint move, const char player,
+                              const char winner, const Bitboard *bb) {
+  uint16_t index = tree->used++;
+  MctsNode *node = &tree->pool[index];
+
+  node->untried = winner ? 0 : bb_empty(bb);
+  node->visits = 0;
+  node->score = 0;
+  node->parent = parent;
+  node->first_child = MCTS_NONE;
+  node->next_sibling = MCTS_NONE;
+  node->move = move;
+  node->player = player;
+  node->winner = winner;
+
+  // Link the node in front of the parent's children
+  if (parent != MCTS_NONE) {
+    node->next_sibling = tree->pool[parent].first_child;
+    tree->pool[parent].first_child = index;
+  }
+  return index;
+}
+
+/*
+The function mcts_select returns the child of parent with the highest UCT value.
+*/
+static uint16_t mcts_select(const MctsTree *tree, const uint16_t parent) {
+  uint32_t log_n = mcts_uct_log(tree->pool[parent].visits);
+
+  uint16_t best = MCTS_NONE;
+  uint64_t best_value = 0;
+
+  // Loop over the children of the parent
+  for (uint16_t child = tree->pool[parent].first_child; child != MCTS_NONE;
+       child = tree->pool[child].next_sibling) {
+    const MctsNode *node = &tree->pool[child];
+    uint64_t value = mcts_uct_value(node->score, node->visits, log_n);
+
+    if (best == MCTS_NONE || value > best_value) {
+      best = child;
+      best_value = value;
+    }
+  }
+  return best;
+}
+
+/*
+The function mcts_playout plays from the given position until the game ends
+and returns the winner (X, O or EMPTY for a draw). The moves follow the
+threats kept by the evaluator: a player who can win does, which ends the
+playout right away, and a player facing a threat blocks it; other moves are
+random. A move that is not a win cannot complete a window, so only the board
+filling up needs checking after it.
+The state is the copy of the root evaluation that the iteration updated along
+its path, so the playout never rescans the windows. The Cortex-M0+ has no
+popcount instruction, which makes a rescan a libgcc call per window and player.
+*/
+static char mcts_playout(MctsTree *tree, EvalState *state, char to_move) {
+  while (true) {
+    // Win if possible
+    if (eval_has_threat(state, to_move)) {
+      return to_move;
+    }
+
+    // Block a threat of the opponent, or else play a random empty cell
+    char opponent = mcts_opponent(to_move);
+    BbMask cells = eval_threat_cells(state, opponent);
+    uint cell = mcts_pick(tree, cells != 0 ? cells : bb_empty(&state->bb));
+    eval_place(state, to_move, cell);
+
+    // Stop when the board is full
+    if (state->filled == BB_CELLS) {
+      return EMPTY;
+    }
+    to_move = opponent;
+  }
+}
+
+// ----------------------------------------
+// Monte Carlo tree search functions
+// ----------------------------------------
+
+/*
+The function mcts_init empties the node pool and creates the root node. The
+root is owned by the player who moved last, so that its children are the moves
+of the player to move. The root position is evaluated once here; the
+iterations copy this state and update it move by move.
+*/
+void mcts_init(MctsTree *tree, const Bitboard *root, const char to_move,
+               const uint32_t seed) {
+  // Reset the pool and the statistics
+  tree->used = 0;
+  eval_from_board(&tree->root, root);
+  tree->to_move = to_move;
+  tree->rng = seed ? seed : 1;
+  tree->iterations = 0;
+  tree->playouts = 0;
+  tree->elapsed_us = 0;
+  tree->pool_full = 0;
+
+  // Find out if the root position is already over
+  char winner = bb_is_win(root->x)    ? X
+                : bb_is_win(root->o)  ? O
+                : bb_empty(root) == 0 ? EMPTY
+                                      : 0;
+
+  // Create the root node
+  mcts_new_node(tree, MCTS_NONE, 0, mcts_opponent(to_move), winner, root);
+}
+
+/*
+The function mcts_run runs iterations of the four UCT steps:
+  - Selection: walk down fully expanded nodes by highest UCT value.
+  - Expansion: add one untried move as a new node, if the pool has room.
+  - Simulation: play a game from the new node, random but for the threats.
+  - Backpropagation: add the result to every node up to the root.
+When the pool is full the search keeps going without expanding, so the tree
+stops growing but the statistics of the existing nodes keep improving.
+*/
+void mcts_run(MctsTree *tree, const uint32_t iterations) {
+  uint64_t start_us = time_us_64();
+
+  for (uint32_t i = 0; i < iterations; i++) {
+    EvalState state = tree->root;
+    uint16_t index = 0;
+    MctsNode *node = &tree->pool[0];
+
+    // Selection
+    while (node->untried == 0 && node->first_child != MCTS_NONE) {
+      index = mcts_select(tree, index);
+      node = &tree->pool[index];
+      eval_place(&state, node->player, node->move);
+    }
+
+    // Expansion
+    if (node->untried != 0) {
+      if (tree->used < MCTS_POOL_SIZE) {
+        uint move = mcts_pick(tree, node->untried);
+        char player = mcts_opponent(node->player);
+        node->untried &= ~(1ull << move);
+        eval_place(&state, player, move);
+        index = mcts_new_node(tree, index, move, player,
+                              mcts_winner(&state, player), &state.bb);
+        node = &tree->pool[index];
+      } else {
+        tree->pool_full++;
+      }
+    }
+
+    // Simulation
+    char winner = node->winner;
+    if (!winner) {
+      winner = mcts_playout(tree, &state, mcts_opponent(node->player));
+      tree->playouts++;
+    }
+
+    // Backpropagation
+    while (index != MCTS_NONE) {
+      node = &tree->pool[index];
+      node->visits++;
+      node->score += mcts_score(winner, node->player);
+      index = node->parent;
+    }
+    tree->iterations++;
+  }
+
+  tree->elapsed_us += time_us_64() - start_us;
+}
+
+/*
+The function mcts_best_move returns the move of the root child with the most
+visits, which is more stable than the best average score.
+*/
+int mcts_best_move(const MctsTree *tree) {
+  int best = -1;
+  uint32_t best_visits = 0;
+
+  // Loop over the children of the root
+  for (uint16_t child = tree->pool[0].first_child; child != MCTS_NONE;
+       child = tree->pool[child].next_sibling) {
+    if (tree->pool[child].visits > best_visits) {
+      best = tree->pool[child].move;
+      best_visits = tree->pool[child].visits;
+    }
+  }
+  return best;
+}
+
+/*
+The function mcts_forced_move reads the threats of the root evaluation. If the
+player to move has none and the opponent threatens a single cell, that cell is
+the only move that does not lose at once. With two or more cells to block the
+game is lost anyway, so the search picks the move.
+*/
+int mcts_forced_move(const MctsTree *tree) {
+  // Nothing to play if the game is already over
+  if (tree->pool[0].winner) {
+    return -1;
+  }
+
+  // Take a win at once
+  BbMask wins = eval_threat_cells(&tree->root, tree->to_move);
+  if (wins != 0) {
+    return __builtin_ctzll(wins);
+  }
+
+  // Block the only winning cell of the opponent
+  BbMask blocks =
+      eval_threat_cells(&tree->root, mcts_opponent(tree->to_move));
+  if (blocks != 0 && (blocks & (blocks - 1)) == 0) {
+    return __builtin_ctzll(blocks);
+  }
+  return -1;
+}
+
+/*
+The function mcts_search is the anytime interface. A forced move is played
+without searching; otherwise it runs the search in batches of
+MCTS_CHECK_INTERVAL iterations and checks the budget between batches, then
+returns the best move found so far.
+*/
+int mcts_search(MctsTree *tree, const Bitboard *root, const char to_move,
+                const MctsBudget budget, const uint32_t seed) {
+  mcts_init(tree, root, to_move, seed);
+
+  // Nothing to search if the game is already over
+  if (tree->pool[0].winner) {
+    return -1;
+  }
+
+  // Play a forced move at once
+  int forced = mcts_forced_move(tree);
+  if (forced >= 0) {
+    return forced;
+  }
+
+  while (true) {
+    // Do not run past the iteration budget
+    uint32_t batch = MCTS_CHECK_INTERVAL;
+    if (budget.max_iterations != 0) {
+      if (tree->iterations >= budget.max_iterations) {
+        break;
+      }
+      if (budget.max_iterations - tree->iterations < batch) {
+        batch = budget.max_iterations - tree->iterations;
+      }
+    }
+
+    mcts_run(tree, batch);
+
+    // Stop when the time budget is spent
+    if (budget.max_us != 0 && tree->elapsed_us >= budget.max_us) {
+      break;
+    }
+    // Stop when neither limit is set, one batch is all we can do
+    if (budget.max_iterations == 0 && budget.max_us == 0) {
+      break;
+    }
+  }
+
+  return mcts_best_move(tree);
+}
+
+/*
+The function mcts_uct_log returns ln(N) of the parent in Q16.16, shifted so
+that the square root in mcts_uct_value stays in 32 bits. A parent that was
+never visited gives 0 instead of calling mcts_ln_q16 with 0.
+*/
+uint32_t mcts_uct_log(const uint32_t visits) {
+  if (visits == 0) {
+    return 0;
+  }
+  return mcts_ln_q16(visits) << 10;
+}
+
+/*
+The function mcts_uct_value computes score / visits + C * sqrt(ln(N) / visits).
+Everything is computed in Q16.16 fixed point; the Cortex-M0+ has no FPU.
+*/
+uint64_t mcts_uct_value(const uint32_t score, const uint32_t visits,
+                        const uint32_t log_n) {
+  // Average score in Q16.16, the score is in half points
+  uint64_t exploit = ((uint64_t)score << 15) / visits;
+
+  // sqrt(ln(N) / n) comes out in Q13, C is Q16, the product is scaled to Q16
+  uint64_t explore =
+      ((uint64_t)MCTS_UCT_C_Q16 * mcts_isqrt(log_n / visits)) >> 13;
+
+  return exploit + explore;
+}
+
+/*
+The function mcts_print_stats prints the iteration and playout counts, the node
+pool usage and the playout rate.
+*/
+void mcts_print_stats(const MctsTree *tree) {
+  printf("MCTS: %lu iterations, %lu playouts in %llu us, %u/%u nodes\n",
+         (unsigned long)tree->iterations, (unsigned long)tree->playouts,
+         (unsigned long long)tree->elapsed_us, tree->used, MCTS_POOL_SIZE);
+  if (tree->elapsed_us > 0) {
+    printf("MCTS: %llu playouts/s\n",
+           (unsigned long long)tree->playouts * 1000000ull / tree->elapsed_us);
+  }
+}
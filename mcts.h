@@ -0,0 +1,164 @@
+#ifndef __MCTS_H__
+#define __MCTS_H__
+
+#include "bitboard.h"
+#include "eval.h"
+#include <stdint.h>
+
+#ifndef MCTS_POOL_SIZE
+#define MCTS_POOL_SIZE 1024 // Number of tree nodes in the fixed node pool
+#endif
+#define MCTS_CHECK_INTERVAL 32 // Iterations between two budget checks
+#define MCTS_NONE 0xFFFF       // Null node index
+#define MCTS_UCT_C_Q16 92682   // Exploration constant sqrt(2) in Q16.16
+
+_Static_assert(MCTS_POOL_SIZE < MCTS_NONE, "node indices are 16 bits");
+
+// Struct for storing one search tree node
+// @field untried moves of this position that have no child node yet
+// @field visits number of playouts that went through this node
+// @field score playout results for the player who moved into this node, in
+// half points (win 2, draw 1, loss 0)
+// @field parent index of the parent node
+// @field first_child index of the first child node
+// @field next_sibling index of the next child of the same parent
+// @field move cell played to reach this node
+// @field player player who played move
+// @field winner winner of the position (X, O, EMPTY for a draw) or 0 if the
+// game goes on
+typedef struct {
+  BbMask untried;
+  uint32_t visits;
+  uint32_t score;
+  uint16_t parent;
+  uint16_t first_child;
+  uint16_t next_sibling;
+  uint8_t move;
+  char player;
+  char winner;
+} MctsNode;
+
+// Struct for storing a search budget, the search stops at the first limit
+// reached
+// @field max_iterations maximum number of iterations, 0 for no limit
+// @field max_us maximum search time in microseconds, 0 for no limit
+typedef struct {
+  uint32_t max_iterations;
+  uint32_t max_us;
+} MctsBudget;
+
+// Struct for storing a search tree and its node pool
+// @field pool fixed node pool, node 0 is the root
+// @field used number of nodes taken from the pool
+// @field root position at the root of the tree and its evaluation, copied by
+// every iteration
+// @field to_move player to move at the root
+// @field rng state of the xorshift random generator
+// @field iterations number of iterations run so far
+// @field playouts number of random playouts run so far
+// @field elapsed_us time spent in mcts_run so far
+// @field pool_full number of expansions skipped because the pool was full
+typedef struct {
+  MctsNode pool[MCTS_POOL_SIZE];
+  uint16_t used;
+  EvalState root;
+  char to_move;
+  uint32_t rng;
+  uint32_t iterations;
+  uint32_t playouts;
+  uint64_t elapsed_us;
+  uint32_t pool_full;
+} MctsTree;
+
+// ----------------------------------------
+// Monte Carlo tree search functions
+// ----------------------------------------
+
+/**
+ * @brief Starts a new search tree for a position
+ *
+ * The playouts follow the threats of the evaluator, so eval_init must have
+ * been called once.
+ *
+ * @param tree Pointer to the search tree
+ * @param root The position to search
+ * @param to_move The player to move
+ * @param seed Seed of the random generator, the same seed gives the same search
+ */
+void mcts_init(MctsTree *tree, const Bitboard *root, const char to_move,
+               const uint32_t seed);
+
+/**
+ * @brief Runs a number of UCT iterations on the tree
+ *
+ * Can be called repeatedly; the best move is available between calls.
+ *
+ * @param tree Pointer to the search tree
+ * @param iterations Number of iterations to run
+ */
+void mcts_run(MctsTree *tree, const uint32_t iterations);
+
+/**
+ * @brief Returns the most visited move of the root
+ *
+ * @param tree Pointer to the search tree
+ * @return The cell index of the best move found so far, or -1 if there is none.
+ */
+int mcts_best_move(const MctsTree *tree);
+
+/**
+ * @brief Returns the move the player to move at the root cannot avoid
+ *
+ * A winning move if there is one, otherwise the block of the opponent's only
+ * winning cell; any other move loses or lets the opponent win at once.
+ *
+ * @param tree Pointer to a tree started with mcts_init
+ * @return The cell index of the forced move, or -1 if the game is over or the
+ * move must be searched.
+ */
+int mcts_forced_move(const MctsTree *tree);
+
+/**
+ * @brief Searches a position until the budget expires
+ *
+ * A forced move (mcts_forced_move) is returned without searching.
+ *
+ * @param tree Pointer to the search tree
+ * @param root The position to search
+ * @param to_move The player to move
+ * @param budget The iteration and time budget
+ * @param seed Seed of the random generator
+ * @return The cell index of the best move found, or -1 if there is none.
+ */
+int mcts_search(MctsTree *tree, const Bitboard *root, const char to_move,
+                const MctsBudget budget, const uint32_t seed);
+
+/**
+ * @brief Computes the parent term of the UCT value, once per parent
+ *
+ * @param visits Number of visits of the parent node, 0 gives 0
+ * @return ln(visits) in the scale expected by mcts_uct_value.
+ */
+uint32_t mcts_uct_log(const uint32_t visits);
+
+/**
+ * @brief Computes the UCT value of a child node in Q16.16
+ *
+ * Used by mcts_run and by the engines of the other board variants.
+ *
+ * @param score Score of the child in half points
+ * @param visits Number of visits of the child, at least 1
+ * @param log_n Parent term returned by mcts_uct_log
+ * @return score / visits + C * sqrt(ln(N) / visits) in Q16.16.
+ */
+uint64_t mcts_uct_value(const uint32_t score, const uint32_t visits,
+                        const uint32_t log_n);
+
+/**
+ * @brief Prints the iteration count, node usage and playouts per second
+ *
+ * @param tree Pointer to the search tree
+ */
+void mcts_print_stats(const MctsTree *tree);
+
+#endif
@@ -0,0 +1,251 @@
+#include "scheduler.h"
+#include "hardware/sync.h"
+
+// Task table
+static SchedTask tasks[SCHED_MAX_TASKS];
+static int task_count = 0;
+// Id of the idle task, SCHED_NONE if there is none
+static int idle_id = SCHED_NONE;
+// Start of the accounting window
+static uint64_t window_start_us = 0;
+// Time spent waiting for the next release
+static uint64_t wait_us = 0;
+
+// ----------------------------------------
+// Internal helpers
+// ----------------------------------------
+
+/*
+The function sched_is_ready checks if a task was triggered or if its periodic
+release time has come.
+*/
+static inline bool sched_is_ready(const SchedTask *task, const uint64_t now) {
+  return task->pending || (task->period_us != 0 && now >= task->release_us);
+}
+
+/*
+The function sched_next_release returns the earliest periodic release of the
+tasks other than the idle task, or UINT64_MAX if there is none.
+*/
+static uint64_t sched_next_release(void) {
+  uint64_t next = UINT64_MAX;
+  for (int i = 0; i < task_count; i++) {
+    if (i != idle_id && tasks[i].period_us != 0 &&
+        tasks[i].release_us < next) {
+      next = tasks[i].release_us;
+    }
+  }
+  return next;
+}
+
+/*
+The function sched_execute runs a task and does its accounting:
+  - The run time is added to the CPU time of the task.
+  - A run longer than the budget is an overrun.
+  - A run finishing after release + deadline is a miss.
+Then the next release of a periodic task is set one period after the current
+one, or one period from now if the task fell more than a period behind, so a
+late task does not run several times in a row to catch up.
+*/
+static void sched_execute(SchedTask *task, const bool check_deadline) {
+  task->pending = false;
+
+  // Run the task
+  uint64_t start = time_us_64();
+  task->run(task->ctx);
+  uint64_t end = time_us_64();
+
+  // Account the run time
+  uint32_t elapsed = end - start;
+  task->runs++;
+  task->cpu_us += elapsed;
+  if (elapsed > task->max_run_us) {
+    task->max_run_us = elapsed;
+  }
+  if (task->budget_us != 0 && elapsed > task->budget_us) {
+    task->overruns++;
+  }
+
+  // Check the deadline
+  uint64_t deadline = task->release_us + task->deadline_us;
+  if (check_deadline && end > deadline) {
+    task->misses++;
+    if (end - deadline > task->max_late_us) {
+      task->max_late_us = end - deadline;
+    }
+  }
+
+  // Schedule the next release
+  if (task->period_us != 0) {
+    task->release_us += task->period_us;
+    if (task->release_us <= end) {
+      task->release_us = end + task->period_us;
+    }
+  }
+}
+
+// ----------------------------------------
+// Scheduler functions
+// ----------------------------------------
+
+/*
+The function sched_init empties the task table and starts a new accounting
+window.
+*/
+void sched_init(void) {
+  task_count = 0;
+  idle_id = SCHED_NONE;
+  window_start_us = time_us_64();
+  wait_us = 0;
+}
+
+/*
+The function sched_add fills in the next task slot. A periodic task is released
+right away, a triggered only task waits for sched_trigger.
+*/
+int sched_add(const char *name, SchedFn run, void *ctx,
+              const uint32_t period_us, const uint32_t deadline_us,
+              const uint32_t budget_us) {
+  if (task_count == SCHED_MAX_TASKS) {
+    return SCHED_NONE;
+  }
+
+  SchedTask *task = &tasks[task_count];
+  *task = (SchedTask){0};
+  task->name = name;
+  task->run = run;
+  task->ctx = ctx;
+  task->period_us = period_us;
+  task->deadline_us = deadline_us;
+  task->budget_us = budget_us;
+  task->release_us = time_us_64();
+  return task_count++;
+}
+
+/*
+The function sched_set_idle marks the idle task. It is never picked by
+deadline, only when nothing else is ready.
+*/
+void sched_set_idle(const int id) {
+  if (id >= 0 && id < task_count) {
+    idle_id = id;
+  }
+}
+
+/*
+The function sched_trigger releases a task now. A periodic task that is not
+due yet is pulled forward; its next release is then one period after this run.
+*/
+void sched_trigger(const int id) {
+  if (id < 0 || id >= task_count) {
+    return;
+  }
+
+  uint64_t now = time_us_64();
+  SchedTask *task = &tasks[id];
+  if (!task->pending && (task->period_us == 0 || task->release_us > now)) {
+    task->release_us = now;
+  }
+  task->pending = true;
+}
+
+/*
+The function sched_resync moves every periodic release to now.
+*/
+void sched_resync(void) {
+  uint64_t now = time_us_64();
+  for (int i = 0; i < task_count; i++) {
+    if (tasks[i].period_us != 0) {
+      tasks[i].release_us = now;
+    }
+  }
+}
+
+/*
+The function sched_run_once picks the ready task with the earliest absolute
+deadline (earliest deadline first) and runs it. When no task is ready the idle
+task runs, and if still nothing is ready core0 waits in WFE until the next
+periodic release; interrupts such as the button edges end the wait early.
+*/
+bool sched_run_once(void) {
+  uint64_t now = time_us_64();
+
+  // Find the ready task with the earliest deadline
+  int best = SCHED_NONE;
+  uint64_t best_deadline = UINT64_MAX;
+  for (int i = 0; i < task_count; i++) {
+    if (i == idle_id || !sched_is_ready(&tasks[i], now)) {
+      continue;
+    }
+    uint64_t deadline = tasks[i].release_us + tasks[i].deadline_us;
+    if (best == SCHED_NONE || deadline < best_deadline) {
+      best = i;
+      best_deadline = deadline;
+    }
+  }
+
+  if (best != SCHED_NONE) {
+    sched_execute(&tasks[best], true);
+    return true;
+  }
+
+  // Nothing is ready, run the idle task
+  if (idle_id != SCHED_NONE) {
+    sched_execute(&tasks[idle_id], false);
+  }
+
+  // Wait for the next release
+  uint64_t next = sched_next_release();
+  now = time_us_64();
+  if (next != UINT64_MAX && next > now) {
+    best_effort_wfe_or_timeout(from_us_since_boot(next));
+    wait_us += time_us_64() - now;
+  }
+  return false;
+}
+
+/*
+The function sched_run is the main loop.
+*/
+void sched_run(void) {
+  while (true) {
+    sched_run_once();
+  }
+}
+
+/*
+The function sched_get_task returns a task by id.
+*/
+const SchedTask *sched_get_task(const int id) {
+  if (id < 0 || id >= task_count) {
+    return NULL;
+  }
+  return &tasks[id];
+}
+
+/*
+The function sched_print_stats prints one line per task with its share of the
+CPU in tenths of a percent, its longest run against its budget and its
+overruns and misses, then the time core0 spent waiting. Integer arithmetic
+only, the Cortex-M0+ has no FPU.
+*/
+void sched_print_stats(void) {
+  uint64_t window = time_us_64() - window_start_us;
+  if (window == 0) {
+    return;
+  }
+
+  for (int i = 0; i < task_count; i++) {
+    const SchedTask *t = &tasks[i];
+    uint32_t permille = t->cpu_us * 1000 / window;
+    printf("Sched: %-8s %7lu runs %3lu.%lu%% cpu, max %lu/%lu us, %lu "
+           "overruns, %lu misses (worst %lu us late)\n",
+           t->name, (unsigned long)t->runs, (unsigned long)permille / 10,
+           (unsigned long)permille % 10, (unsigned long)t->max_run_us,
+           (unsigned long)t->budget_us, (unsigned long)t->overruns,
+           (unsigned long)t->misses, (unsigned long)t->max_late_us);
+  }
+  uint32_t permille = wait_us * 1000 / window;
+  printf("Sched: waiting %lu.%lu%%\n", (unsigned long)permille / 10,
+         (unsigned long)permille % 10);
+}
@@ -0,0 +1,129 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include "game.h"
+#include <stdint.h>
+
+// Cooperative deadline-driven scheduler for core0
+// Every task has a period (0 for tasks that only run when triggered), a
+// relative deadline and a time budget per run. The ready task with the
+// earliest absolute deadline runs first and runs to completion; when nothing
+// is ready the idle task runs and core0 waits in WFE for the next release.
+// Runs longer than their budget and runs finishing after their deadline are
+// counted per task, together with the CPU time each task used.
+
+#define SCHED_MAX_TASKS 8 // Maximum number of tasks
+#define SCHED_NONE -1     // Task id returned when the table is full
+
+// Task function, called with the context given to sched_add
+typedef void (*SchedFn)(void *ctx);
+
+// Struct for storing one task and its accounting
+// @field name name printed in the statistics
+// @field run task function
+// @field ctx context passed to run
+// @field period_us time between two releases, 0 for triggered only
+// @field deadline_us time from a release to the deadline of the run
+// @field budget_us maximum time of one run, 0 for no limit
+// @field release_us time of the current or next release
+// @field pending true when sched_trigger released the task
+// @field runs number of runs
+// @field cpu_us accumulated run time
+// @field max_run_us longest run
+// @field overruns number of runs longer than budget_us
+// @field misses number of runs that finished after their deadline
+// @field max_late_us worst time past the deadline
+typedef struct {
+  const char *name;
+  SchedFn run;
+  void *ctx;
+  uint32_t period_us;
+  uint32_t deadline_us;
+  uint32_t budget_us;
+  uint64_t release_us;
+  bool pending;
+  uint32_t runs;
+  uint64_t cpu_us;
+  uint32_t max_run_us;
+  uint32_t overruns;
+  uint32_t misses;
+  uint32_t max_late_us;
+} SchedTask;
+
+// ----------------------------------------
+// Scheduler functions
+// ----------------------------------------
+
+/**
+ * @brief Empties the task table and starts the accounting window
+ */
+void sched_init(void);
+
+/**
+ * @brief Adds a task, first released right away if periodic
+ *
+ * @param name Name printed in the statistics
+ * @param run Task function
+ * @param ctx Context passed to run
+ * @param period_us Time between two releases, 0 for triggered only
+ * @param deadline_us Time from a release to the deadline of the run
+ * @param budget_us Maximum time of one run, 0 for no limit
+ * @return The task id, or SCHED_NONE if the table is full.
+ */
+int sched_add(const char *name, SchedFn run, void *ctx,
+              const uint32_t period_us, const uint32_t deadline_us,
+              const uint32_t budget_us);
+
+/**
+ * @brief Makes a task the idle task, run whenever no other task is ready
+ *
+ * The idle task has no deadline.
+ *
+ * @param id Task id returned by sched_add
+ */
+void sched_set_idle(const int id);
+
+/**
+ * @brief Releases a task now, e.g. when its input changed
+ *
+ * Call from task context only, not from interrupts.
+ *
+ * @param id Task id returned by sched_add
+ */
+void sched_trigger(const int id);
+
+/**
+ * @brief Moves every periodic release to now
+ *
+ * Call after core0 was blocked on purpose (e.g. asleep), so that the time
+ * asleep does not count as missed deadlines.
+ */
+void sched_resync(void);
+
+/**
+ * @brief Runs the ready task with the earliest deadline, or the idle task
+ *
+ * @return true If a task other than the idle task ran
+ */
+bool sched_run_once(void);
+
+/**
+ * @brief Runs the tasks forever
+ */
+void sched_run(void);
+
+/**
+ * @brief Returns a task and its accounting
+ *
+ * @param id Task id returned by sched_add
+ * @return Pointer to the task, or NULL if the id is not valid.
+ */
+const SchedTask *sched_get_task(const int id);
+
+/**
+ * @brief Prints the CPU share, longest run, overruns and deadline misses of
+ * every task since sched_init
+ */
+void sched_print_stats(void);
+
+#endif
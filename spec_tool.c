@@ -0,0 +1,398 @@
+#include "spectator.h"
+#include "bitboard.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Spectator fan-out tool (host build only)
+//   spec_tool bench [SPECTATORS] [GAMES] [SECONDS] [SLOW] [BATCH]
+//       Connects SPECTATORS loopback sockets (default 10000) watching GAMES
+//       games (default 100), SLOW of which (default 100) never read, then
+//       plays one random move in every game per round for SECONDS seconds
+//       (default 5) and publishes a frame for each. The hub sends after every
+//       BATCH rounds (default 16, at most SPEC_QUEUE_FRAMES / 2), so a sendmsg
+//       carries up to BATCH frames. Prints the frames and deliveries per
+//       second, the backpressure counters and the memory of the hub against
+//       one copy of every frame per spectator, and checks that every spectator
+//       that kept up received every frame of its game in order.
+//
+// The spectators run in a child process, so each process holds one socket per
+// spectator.
+
+#define TOOL_SLOW_RCVBUF 4096          // Receive buffer of the slow spectators
+#define TOOL_SNDBUF 16384              // Send buffer of the hub sockets
+#define TOOL_DRAIN_NS 5000000000ull    // Longest wait for the last frames
+
+// Struct for storing what one spectator received, shared with the child
+// @field bytes number of bytes received
+// @field last_seq frame number of the last frame
+// @field bad number of frames that were malformed, out of order or of another
+// game
+// @field frame bytes of the frame being received
+typedef struct {
+  uint64_t bytes;
+  uint32_t last_seq;
+  uint32_t bad;
+  uint8_t frame[sizeof(SpecWire)];
+} ToolWatcher;
+
+// Struct for storing one game played by the bench
+// @field bb the board
+// @field player the player to move
+// @field over true once the game is won or the board is full
+typedef struct {
+  Bitboard bb;
+  char player;
+  bool over;
+} ToolGame;
+
+// ----------------------------------------
+// Helpers
+// ----------------------------------------
+
+/*
+The function tool_ns reads the monotonic clock in nanoseconds.
+*/
+static uint64_t tool_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+The function tool_rand is a xorshift32 generator.
+*/
+static uint32_t tool_rand(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+/*
+The function tool_move plays one step of a game: a random move, or a reset
+once the game is over, as with BTN3. A full board without a winner is over
+too, as in handle_btn2.
+*/
+static WalRecord tool_move(ToolGame *game, const uint32_t session,
+                           uint32_t *rng) {
+  WalRecord record = {.session = session, .type = WAL_RESET};
+  if (game->over) {
+    *game = (ToolGame){.player = X};
+    return record;
+  }
+
+  // Pick a random empty cell
+  BbMask empty = bb_empty(&game->bb);
+  uint skip = tool_rand(rng) % __builtin_popcountll(empty);
+  while (skip-- > 0) {
+    empty &= empty - 1;
+  }
+  uint cell = __builtin_ctzll(empty);
+
+  bb_place(&game->bb, game->player, cell);
+  record.type = WAL_MOVE;
+  record.cell = cell;
+  record.player = game->player;
+  if (bb_is_win_at(bb_pieces(&game->bb, game->player), cell)) {
+    record.flags = WAL_GAME_OVER;
+    game->over = true;
+  } else {
+    game->over = bb_empty(&game->bb) == 0;
+  }
+  game->player = game->player == X ? O : X;
+  return record;
+}
+
+/*
+The function tool_receive adds the bytes read from one socket to the frame of
+its spectator and checks every frame completed.
+*/
+static void tool_receive(ToolWatcher *w, const uint32_t game,
+                         const uint8_t *data, size_t size) {
+  while (size > 0) {
+    size_t at = w->bytes % sizeof(SpecWire);
+    size_t n = sizeof(SpecWire) - at < size ? sizeof(SpecWire) - at : size;
+    memcpy(w->frame + at, data, n);
+    w->bytes += n;
+    data += n;
+    size -= n;
+
+    if (w->bytes % sizeof(SpecWire) == 0) {
+      SpecWire wire;
+      char board[ROWS][COLS];
+      memcpy(&wire, w->frame, sizeof(wire));
+      if (!spec_decode(&wire, board) || wire.seq <= w->last_seq ||
+          wire.move.session != game) {
+        w->bad++;
+      }
+      w->last_seq = wire.seq;
+    }
+  }
+}
+
+/*
+The function tool_watch runs in the child: it connects every spectator, sends
+its index, then reads the fast ones until the hub closes them.
+*/
+static void tool_watch(const uint16_t port, const uint32_t spectators,
+                       const uint32_t games, const uint32_t slow,
+                       ToolWatcher *watchers) {
+  int ep = epoll_create1(0);
+  uint32_t open_fast = 0;
+  struct sockaddr_in addr = {.sin_family = AF_INET,
+                             .sin_port = htons(port),
+                             .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+
+  for (uint32_t i = 0; i < spectators; i++) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+      perror("spec_tool: socket");
+      _exit(1);
+    }
+    if (i < slow) {
+      int size = TOOL_SLOW_RCVBUF;
+      setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        send(fd, &i, sizeof(i), 0) != sizeof(i)) {
+      perror("spec_tool: connect");
+      _exit(1);
+    }
+    if (i >= slow) {
+      struct epoll_event ev = {.events = EPOLLIN,
+                               .data.u64 = (uint64_t)i << 32 | (uint32_t)fd};
+      epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+      open_fast++;
+    }
+  }
+
+  // Read until the hub has closed every fast spectator
+  static uint8_t buf[65536];
+  struct epoll_event events[256];
+  while (open_fast > 0) {
+    int n = epoll_wait(ep, events, 256, -1);
+    if (n < 0 && errno != EINTR) {
+      perror("spec_tool: epoll_wait");
+      _exit(1);
+    }
+    for (int e = 0; e < n; e++) {
+      uint32_t i = events[e].data.u64 >> 32;
+      int fd = (int)(uint32_t)events[e].data.u64;
+      ssize_t got = read(fd, buf, sizeof(buf));
+      if (got > 0) {
+        tool_receive(&watchers[i], i % games, buf, got);
+      } else if (got == 0 || (errno != EAGAIN && errno != EINTR)) {
+        close(fd);
+        open_fast--;
+      }
+    }
+  }
+  _exit(0);
+}
+
+/*
+The function tool_listen opens a loopback socket on a free port.
+*/
+static int tool_listen(uint16_t *port) {
+  struct sockaddr_in addr = {.sin_family = AF_INET,
+                             .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  socklen_t len = sizeof(addr);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(fd, SOMAXCONN) < 0 ||
+      getsockname(fd, (struct sockaddr *)&addr, &len) < 0) {
+    perror("spec_tool: listen");
+    return -1;
+  }
+  *port = ntohs(addr.sin_port);
+  return fd;
+}
+
+/*
+The function tool_raise_fds raises the limit of open files to the hard limit.
+*/
+static void tool_raise_fds(const uint32_t needed) {
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < needed) {
+    fprintf(stderr, "spec_tool: %lu open files allowed, %lu needed\n",
+            (unsigned long)rl.rlim_cur, (unsigned long)needed);
+  }
+}
+
+// ----------------------------------------
+// bench
+// ----------------------------------------
+
+/*
+The function tool_bench subscribes the spectators as they connect, plays the
+rounds, drops the slow spectators that are left and sends the last frames to
+the others, then compares what every fast spectator received with what the
+hub sent it.
+*/
+static int tool_bench(const uint32_t spectators, const uint32_t games,
+                      const uint seconds, const uint32_t slow,
+                      const uint batch) {
+  tool_raise_fds(spectators + 16);
+  uint16_t port;
+  int listen_fd = tool_listen(&port);
+  uint32_t *ids = malloc(spectators * sizeof(uint32_t));
+  ToolGame *game = calloc(games, sizeof(ToolGame));
+  ToolWatcher *watchers =
+      mmap(NULL, spectators * sizeof(ToolWatcher), PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  SpecHub hub;
+  if (listen_fd < 0 || ids == NULL || game == NULL || watchers == MAP_FAILED ||
+      !spec_hub_init(&hub, spectators, games)) {
+    return 1;
+  }
+  memset(watchers, 0, spectators * sizeof(ToolWatcher));
+  for (uint32_t g = 0; g < games; g++) {
+    game[g].player = X;
+  }
+
+  fflush(stdout);
+  pid_t child = fork();
+  if (child == 0) {
+    close(listen_fd);
+    tool_watch(port, spectators, games, slow, watchers);
+  }
+
+  // Subscribe every spectator to its game as it connects
+  uint64_t start = tool_ns();
+  for (uint32_t n = 0; n < spectators; n++) {
+    uint32_t i;
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0 || recv(fd, &i, sizeof(i), MSG_WAITALL) != sizeof(i) ||
+        i >= spectators) {
+      perror("spec_tool: accept");
+      kill(child, SIGKILL);
+      return 1;
+    }
+    int size = TOOL_SNDBUF;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    ids[i] = spec_subscribe(&hub, fd, i % games);
+  }
+  close(listen_fd);
+  printf("spectators: %lu on %lu games (%lu slow), connected in %.0f ms\n",
+         (unsigned long)spectators, (unsigned long)games, (unsigned long)slow,
+         (tool_ns() - start) / 1e6);
+
+  // Play the rounds, one move per game, and send after every batch
+  uint32_t rng = 0x9e3779b9u;
+  uint64_t rounds = 0;
+  start = tool_ns();
+  uint64_t elapsed = 0;
+  while (elapsed < seconds * 1000000000ull) {
+    for (uint32_t g = 0; g < games; g++) {
+      WalRecord record = tool_move(&game[g], g, &rng);
+      spec_publish(&hub, &record, &game[g].bb);
+    }
+    if (++rounds % batch == 0 && spec_flush(&hub) > 0) {
+      sched_yield();
+    }
+    elapsed = tool_ns() - start;
+  }
+  SpecStats st = hub.stats;
+  uint64_t memory = spec_memory(&hub);
+
+  // Drop the slow spectators still there and send the rest
+  uint32_t slow_evicted = 0;
+  for (uint32_t i = 0; i < slow; i++) {
+    slow_evicted += !spec_is_subscribed(&hub, ids[i]);
+    spec_unsubscribe(&hub, ids[i]);
+  }
+  uint64_t drain_start = tool_ns();
+  while (spec_flush(&hub) > 0 && tool_ns() - drain_start < TOOL_DRAIN_NS) {
+    sched_yield();
+  }
+
+  // Frames each fast spectator should have, then close them
+  uint64_t *expected = malloc(spectators * sizeof(uint64_t));
+  uint32_t fast_evicted = 0;
+  for (uint32_t i = slow; i < spectators; i++) {
+    bool kept = spec_is_subscribed(&hub, ids[i]) &&
+                hub.subs[ids[i]].head == hub.subs[ids[i]].tail;
+    fast_evicted += !kept;
+    expected[i] = kept ? hub.subs[ids[i]].sent : UINT64_MAX;
+  }
+  spec_hub_free(&hub);
+  int status = 0;
+  waitpid(child, &status, 0);
+
+  uint32_t differ = 0;
+  uint64_t bad = 0;
+  for (uint32_t i = slow; i < spectators; i++) {
+    differ += expected[i] != UINT64_MAX &&
+              watchers[i].bytes != expected[i] * sizeof(SpecWire);
+    bad += watchers[i].bad;
+  }
+
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  double secs = elapsed / 1e9;
+  printf("publish: %llu frames in %llu rounds, %.1f s: %.0f frames/s, %.0f "
+         "deliveries/s, %.1f MB/s\n",
+         (unsigned long long)st.frames, (unsigned long long)rounds, secs,
+         st.frames / secs, st.sent / secs, st.bytes / 1e6 / secs);
+  printf("backpressure: %llu sendmsg, %llu blocked, %llu evicted (%lu of %lu "
+         "slow, %lu fast)\n",
+         (unsigned long long)st.sends, (unsigned long long)st.blocked,
+         (unsigned long long)st.evicted, (unsigned long)slow_evicted,
+         (unsigned long)slow, (unsigned long)fast_evicted);
+  printf("memory: hub %.1f KB (%lu frames allocated, peak %lu live), peak "
+         "%llu queued frames, %.1f KB as copies, max RSS %ld KB\n",
+         memory / 1e3, (unsigned long)st.frames_allocated,
+         (unsigned long)st.frames_peak, (unsigned long long)st.queued_peak,
+         st.queued_peak * sizeof(SpecWire) / 1e3, ru.ru_maxrss);
+  printf("check: %s, %lu fast spectators differ, %llu bad frames\n",
+         differ == 0 && bad == 0 && status == 0 ? "ok" : "FAILED",
+         (unsigned long)differ, (unsigned long long)bad);
+
+  free(expected);
+  free(game);
+  free(ids);
+  munmap(watchers, spectators * sizeof(ToolWatcher));
+  return differ == 0 && bad == 0 && status == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  bb_init();
+
+  if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+    uint32_t spectators = argc > 2 ? strtoul(argv[2], NULL, 0) : 10000;
+    uint32_t games = argc > 3 ? strtoul(argv[3], NULL, 0) : 100;
+    uint seconds = argc > 4 ? (uint)strtoul(argv[4], NULL, 0) : 5;
+    uint32_t slow = argc > 5 ? strtoul(argv[5], NULL, 0) : 100;
+    uint batch = argc > 6 ? (uint)strtoul(argv[6], NULL, 0) : 16;
+    spectators = spectators ? spectators : 1;
+    batch = batch < 1 ? 1 : batch;
+    batch = batch > SPEC_QUEUE_FRAMES / 2 ? SPEC_QUEUE_FRAMES / 2 : batch;
+    return tool_bench(spectators, games ? games : 1, seconds,
+                      slow < spectators ? slow : spectators, batch);
+  }
+
+  fprintf(stderr,
+          "usage: %s bench [SPECTATORS] [GAMES] [SECONDS] [SLOW] [BATCH]\n",
+          argv[0]);
+  return 2;
+}
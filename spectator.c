@@ -0,0 +1,361 @@
+#include "spectator.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define SPEC_QUEUE_MASK (SPEC_QUEUE_FRAMES - 1)
+
+// ----------------------------------------
+// Helpers
+// ----------------------------------------
+
+/*
+The function spec_frame_alloc takes a frame from the free list, or allocates
+one when the list is empty.
+*/
+static SpecFrame *spec_frame_alloc(SpecHub *hub) {
+  SpecFrame *frame = hub->free_frames;
+  if (frame != NULL) {
+    hub->free_frames = frame->next;
+    return frame;
+  }
+  frame = malloc(sizeof(SpecFrame));
+  if (frame != NULL) {
+    hub->stats.frames_allocated++;
+  }
+  return frame;
+}
+
+/*
+The function spec_frame_release drops one reference; the last one puts the
+frame back on the free list.
+*/
+static void spec_frame_release(SpecHub *hub, SpecFrame *frame) {
+  if (--frame->refs == 0) {
+    frame->next = hub->free_frames;
+    hub->free_frames = frame;
+    hub->stats.frames_live--;
+  }
+}
+
+/*
+The function spec_pending_remove takes a spectator out of the pending list by
+moving the last entry into its place.
+*/
+static void spec_pending_remove(SpecHub *hub, const uint32_t id) {
+  for (uint32_t i = 0; i < hub->pending_count; i++) {
+    if (hub->pending[i] == id) {
+      hub->pending[i] = hub->pending[--hub->pending_count];
+      break;
+    }
+  }
+  hub->subs[id].pending = false;
+}
+
+/*
+The function spec_drop releases the queued frames of a spectator, unlinks it
+from its session, closes its socket and frees its slot.
+*/
+static void spec_drop(SpecHub *hub, const uint32_t id) {
+  SpecSubscriber *sub = &hub->subs[id];
+
+  // Release the frames not sent
+  for (; sub->head != sub->tail; sub->head++) {
+    spec_frame_release(hub, sub->queue[sub->head & SPEC_QUEUE_MASK]);
+    hub->stats.queued--;
+  }
+  if (sub->pending) {
+    spec_pending_remove(hub, id);
+  }
+
+  // Unlink it from the spectators of the session
+  if (sub->prev != SPEC_NONE) {
+    hub->subs[sub->prev].next = sub->next;
+  } else {
+    hub->heads[sub->session] = sub->next;
+  }
+  if (sub->next != SPEC_NONE) {
+    hub->subs[sub->next].prev = sub->prev;
+  }
+
+  close(sub->fd);
+  sub->fd = -1;
+  sub->next = hub->free_slot;
+  hub->free_slot = id;
+  hub->stats.subscribers--;
+}
+
+/*
+The function spec_send writes the queued frames of one spectator, SPEC_IOV at
+a time, pointing the I/O vector at the shared frames. It stops at the first
+short write, the socket is full then.
+@return false if the socket failed.
+*/
+static bool spec_send(SpecHub *hub, SpecSubscriber *sub) {
+  while (sub->head != sub->tail) {
+    // Point at the frames, the first one from the bytes not sent yet
+    struct iovec iov[SPEC_IOV];
+    uint count = 0;
+    size_t total = 0;
+    for (uint32_t q = sub->head; q != sub->tail && count < SPEC_IOV; q++) {
+      const uint8_t *bytes =
+          (const uint8_t *)&sub->queue[q & SPEC_QUEUE_MASK]->wire;
+      uint32_t skip = q == sub->head ? sub->offset : 0;
+      iov[count].iov_base = (void *)(bytes + skip);
+      iov[count].iov_len = sizeof(SpecWire) - skip;
+      total += iov[count].iov_len;
+      count++;
+    }
+
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = count};
+    ssize_t n = sendmsg(sub->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    hub->stats.sends++;
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        hub->stats.blocked++;
+        return true;
+      }
+      return false;
+    }
+    hub->stats.bytes += n;
+
+    // Release the frames sent in full
+    size_t left = n;
+    while (left > 0) {
+      size_t rest = sizeof(SpecWire) - sub->offset;
+      if (left < rest) {
+        sub->offset += left;
+        break;
+      }
+      left -= rest;
+      spec_frame_release(hub, sub->queue[sub->head & SPEC_QUEUE_MASK]);
+      sub->head++;
+      sub->offset = 0;
+      sub->sent++;
+      hub->stats.sent++;
+      hub->stats.queued--;
+    }
+    if ((size_t)n < total) {
+      hub->stats.blocked++;
+      return true;
+    }
+  }
+  return true;
+}
+
+// ----------------------------------------
+// Hub functions
+// ----------------------------------------
+
+/*
+The function spec_hub_init allocates the tables and chains every slot in the
+free list.
+*/
+bool spec_hub_init(SpecHub *hub, const uint32_t capacity,
+                   const uint32_t sessions) {
+  memset(hub, 0, sizeof(*hub));
+  hub->subs = malloc((size_t)capacity * sizeof(SpecSubscriber));
+  hub->heads = malloc((size_t)sessions * sizeof(uint32_t));
+  hub->pending = malloc((size_t)capacity * sizeof(uint32_t));
+  if (capacity == 0 || sessions == 0 || hub->subs == NULL ||
+      hub->heads == NULL || hub->pending == NULL) {
+    spec_hub_free(hub);
+    return false;
+  }
+  hub->capacity = capacity;
+  hub->session_count = sessions;
+
+  for (uint32_t i = 0; i < capacity; i++) {
+    hub->subs[i].fd = -1;
+    hub->subs[i].next = i + 1 < capacity ? i + 1 : SPEC_NONE;
+  }
+  hub->free_slot = 0;
+  for (uint32_t s = 0; s < sessions; s++) {
+    hub->heads[s] = SPEC_NONE;
+  }
+  return true;
+}
+
+/*
+The function spec_hub_free drops every spectator, which puts every frame back
+on the free list, then frees the frames and the tables.
+*/
+void spec_hub_free(SpecHub *hub) {
+  for (uint32_t i = 0; i < hub->capacity; i++) {
+    if (hub->subs[i].fd >= 0) {
+      spec_drop(hub, i);
+    }
+  }
+  while (hub->free_frames != NULL) {
+    SpecFrame *next = hub->free_frames->next;
+    free(hub->free_frames);
+    hub->free_frames = next;
+  }
+  free(hub->subs);
+  free(hub->heads);
+  free(hub->pending);
+  memset(hub, 0, sizeof(*hub));
+}
+
+/*
+The function spec_subscribe takes a free slot and puts the spectator first in
+the list of its session.
+*/
+uint32_t spec_subscribe(SpecHub *hub, const int fd, const uint32_t session) {
+  uint32_t id = hub->free_slot;
+  if (id == SPEC_NONE || session >= hub->session_count || fd < 0) {
+    return SPEC_NONE;
+  }
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    return SPEC_NONE;
+  }
+
+  SpecSubscriber *sub = &hub->subs[id];
+  hub->free_slot = sub->next;
+  sub->fd = fd;
+  sub->session = session;
+  sub->prev = SPEC_NONE;
+  sub->next = hub->heads[session];
+  sub->head = 0;
+  sub->tail = 0;
+  sub->offset = 0;
+  sub->pending = false;
+  sub->sent = 0;
+  if (sub->next != SPEC_NONE) {
+    hub->subs[sub->next].prev = id;
+  }
+  hub->heads[session] = id;
+  hub->stats.subscribers++;
+  return id;
+}
+
+/*
+The function spec_unsubscribe ignores ids that are not subscribed.
+*/
+void spec_unsubscribe(SpecHub *hub, const uint32_t id) {
+  if (spec_is_subscribed(hub, id)) {
+    spec_drop(hub, id);
+  }
+}
+
+/*
+The function spec_publish builds the frame once, then queues a pointer to it
+for every spectator of the session. No frame is built for a session nobody
+watches.
+*/
+uint32_t spec_publish(SpecHub *hub, const WalRecord *record,
+                      const Bitboard *bb) {
+  if (record->session >= hub->session_count ||
+      hub->heads[record->session] == SPEC_NONE) {
+    return 0;
+  }
+  SpecFrame *frame = spec_frame_alloc(hub);
+  if (frame == NULL) {
+    return 0;
+  }
+  hub->stats.frames++;
+  frame->refs = 0;
+  frame->wire = (SpecWire){.magic = SPEC_MAGIC,
+                           .seq = (uint32_t)hub->stats.frames,
+                           .move = *record,
+                           .x = bb->x,
+                           .o = bb->o};
+
+  // Queue it, evicting the spectators that are too far behind
+  uint32_t id = hub->heads[record->session];
+  while (id != SPEC_NONE) {
+    SpecSubscriber *sub = &hub->subs[id];
+    uint32_t next = sub->next;
+    if (sub->tail - sub->head == SPEC_QUEUE_FRAMES) {
+      spec_drop(hub, id);
+      hub->stats.evicted++;
+    } else {
+      sub->queue[sub->tail++ & SPEC_QUEUE_MASK] = frame;
+      frame->refs++;
+      if (!sub->pending) {
+        sub->pending = true;
+        hub->pending[hub->pending_count++] = id;
+      }
+    }
+    id = next;
+  }
+
+  // Nobody left to send it to
+  if (frame->refs == 0) {
+    frame->next = hub->free_frames;
+    hub->free_frames = frame;
+    return 0;
+  }
+  hub->stats.deliveries += frame->refs;
+  hub->stats.queued += frame->refs;
+  if (hub->stats.queued > hub->stats.queued_peak) {
+    hub->stats.queued_peak = hub->stats.queued;
+  }
+  if (++hub->stats.frames_live > hub->stats.frames_peak) {
+    hub->stats.frames_peak = hub->stats.frames_live;
+  }
+  return frame->refs;
+}
+
+/*
+The function spec_flush walks the pending list from the end, so the entry of a
+spectator that is emptied or evicted can be replaced by the last entry, which
+was already handled.
+*/
+uint32_t spec_flush(SpecHub *hub) {
+  for (uint32_t i = hub->pending_count; i-- > 0;) {
+    uint32_t id = hub->pending[i];
+    SpecSubscriber *sub = &hub->subs[id];
+    bool ok = spec_send(hub, sub);
+    if (!ok || sub->head == sub->tail) {
+      hub->pending[i] = hub->pending[--hub->pending_count];
+      sub->pending = false;
+    }
+    if (!ok) {
+      spec_drop(hub, id);
+      hub->stats.evicted++;
+    }
+  }
+  return hub->pending_count;
+}
+
+/*
+The function spec_memory adds up the tables and every frame allocated.
+*/
+uint64_t spec_memory(const SpecHub *hub) {
+  return (uint64_t)hub->capacity * (sizeof(SpecSubscriber) + sizeof(uint32_t)) +
+         (uint64_t)hub->session_count * sizeof(uint32_t) +
+         (uint64_t)hub->stats.frames_allocated * sizeof(SpecFrame);
+}
+
+// ----------------------------------------
+// Spectator functions
+// ----------------------------------------
+
+/*
+The function spec_decode checks the magic, that no cell holds both pieces and
+that a move holds the piece of its player.
+*/
+bool spec_decode(const SpecWire *wire, char board[ROWS][COLS]) {
+  if (wire->magic != SPEC_MAGIC || (wire->x & wire->o) != 0 ||
+      ((wire->x | wire->o) & ~BB_FULL) != 0) {
+    return false;
+  }
+  Bitboard bb = {.x = wire->x, .o = wire->o};
+  if (wire->move.type == WAL_MOVE &&
+      (wire->move.cell >= BB_CELLS || (wire->move.player != X &&
+                                       wire->move.player != O) ||
+       ((bb_pieces(&bb, wire->move.player) >> wire->move.cell) & 1) == 0)) {
+    return false;
+  }
+  bb_to_board(&bb, board);
+  return true;
+}
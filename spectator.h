@@ -0,0 +1,235 @@
+#ifndef __SPECTATOR_H__
+#define __SPECTATOR_H__
+
+#include "bitboard.h"
+#include "wal.h"
+#include <stdint.h>
+
+// Spectator fan-out for hosted games (host only)
+// Every committed move becomes one immutable frame, the journal record of the
+// move followed by the board after it, built once whatever the number of
+// spectators. Each spectator has a send queue of pointers to shared frames and
+// a frame counts the queues holding it; it goes back to the hub's free list
+// when the last one has sent it. Frames are written to the sockets straight
+// from the shared frames, several per sendmsg.
+//
+// Backpressure: a spectator whose socket is full keeps its frames queued and
+// is skipped until the next spec_flush. A spectator that still has
+// SPEC_QUEUE_FRAMES frames queued when the next one is published is too slow
+// and is evicted: its socket is closed and its frames are released.
+//
+// A hub and its frames belong to the thread that calls its functions, so the
+// reference counts need no atomic operations.
+
+#define SPEC_MAGIC 0x43455053u // "SPEC", start of every frame
+#ifndef SPEC_QUEUE_FRAMES
+#define SPEC_QUEUE_FRAMES 64   // Frames queued per spectator before eviction
+#endif
+#define SPEC_IOV 16            // Maximum frames per sendmsg
+#define SPEC_NONE UINT32_MAX   // End of a spectator list
+
+_Static_assert((SPEC_QUEUE_FRAMES & (SPEC_QUEUE_FRAMES - 1)) == 0,
+               "SPEC_QUEUE_FRAMES is a power of two");
+
+// Struct for storing one frame as sent to the spectators (little endian)
+// @field magic SPEC_MAGIC
+// @field seq frame number in the hub, from 1
+// @field move journal record of the move
+// @field x cells occupied by X after the move, bit index is row * COLS + col
+// @field o cells occupied by O after the move
+typedef struct {
+  uint32_t magic;
+  uint32_t seq;
+  WalRecord move;
+  uint64_t x;
+  uint64_t o;
+} SpecWire;
+
+_Static_assert(sizeof(SpecWire) == 32, "SpecWire layout");
+
+// Struct for storing one shared frame
+// @field refs number of send queues holding the frame
+// @field next next frame of the free list
+// @field wire the bytes sent, never changed while refs is not 0
+typedef struct SpecFrame {
+  uint32_t refs;
+  struct SpecFrame *next;
+  SpecWire wire;
+} SpecFrame;
+
+// Struct for storing one spectator
+// @field fd socket of the spectator, -1 if the slot is free
+// @field session session watched
+// @field prev previous spectator of the session, SPEC_NONE if first
+// @field next next spectator of the session, or next free slot
+// @field head index of the next frame to send in queue
+// @field tail index of the next free entry in queue
+// @field offset bytes of the frame at head already sent
+// @field pending true while the spectator is in the hub's pending list
+// @field sent number of frames sent
+// @field queue frames waiting to be sent
+typedef struct {
+  int fd;
+  uint32_t session;
+  uint32_t prev;
+  uint32_t next;
+  uint32_t head;
+  uint32_t tail;
+  uint32_t offset;
+  bool pending;
+  uint64_t sent;
+  SpecFrame *queue[SPEC_QUEUE_FRAMES];
+} SpecSubscriber;
+
+// Struct for storing the hub counters
+// @field frames number of frames published
+// @field deliveries number of frames put in send queues
+// @field sent number of frames sent
+// @field bytes number of bytes sent
+// @field sends number of sendmsg calls
+// @field blocked number of sendmsg calls stopped by a full socket
+// @field evicted number of spectators evicted
+// @field subscribers number of spectators subscribed
+// @field frames_live number of frames held by send queues
+// @field frames_peak largest frames_live
+// @field frames_allocated number of frames allocated, live or free
+// @field queued number of send queue entries in use
+// @field queued_peak largest queued
+typedef struct {
+  uint64_t frames;
+  uint64_t deliveries;
+  uint64_t sent;
+  uint64_t bytes;
+  uint64_t sends;
+  uint64_t blocked;
+  uint64_t evicted;
+  uint32_t subscribers;
+  uint32_t frames_live;
+  uint32_t frames_peak;
+  uint32_t frames_allocated;
+  uint64_t queued;
+  uint64_t queued_peak;
+} SpecStats;
+
+// Struct for storing a hub
+// @field subs the spectator slots
+// @field capacity number of slots
+// @field free_slot first free slot, SPEC_NONE if full
+// @field heads first spectator of every session, SPEC_NONE if none
+// @field session_count number of sessions
+// @field pending spectators with queued frames
+// @field pending_count number of entries in pending
+// @field free_frames free list of frames
+// @field stats hub counters
+typedef struct {
+  SpecSubscriber *subs;
+  uint32_t capacity;
+  uint32_t free_slot;
+  uint32_t *heads;
+  uint32_t session_count;
+  uint32_t *pending;
+  uint32_t pending_count;
+  SpecFrame *free_frames;
+  SpecStats stats;
+} SpecHub;
+
+// ----------------------------------------
+// Hub functions
+// ----------------------------------------
+
+/**
+ * @brief Allocates the spectator slots and session lists of a hub
+ *
+ * @param hub Pointer to the hub
+ * @param capacity Maximum number of spectators
+ * @param sessions Number of sessions that can be watched
+ * @return true on success, false otherwise.
+ */
+bool spec_hub_init(SpecHub *hub, const uint32_t capacity,
+                   const uint32_t sessions);
+
+/**
+ * @brief Closes every spectator socket and frees the hub
+ *
+ * @param hub Pointer to the hub
+ */
+void spec_hub_free(SpecHub *hub);
+
+/**
+ * @brief Adds a spectator
+ *
+ * The hub owns the socket from then on and makes it non-blocking.
+ *
+ * @param hub Pointer to the hub
+ * @param fd Connected socket of the spectator
+ * @param session Session watched
+ * @return The spectator id, SPEC_NONE if the hub is full or the session does
+ * not exist.
+ */
+uint32_t spec_subscribe(SpecHub *hub, const int fd, const uint32_t session);
+
+/**
+ * @brief Removes a spectator, drops its queued frames and closes its socket
+ *
+ * @param hub Pointer to the hub
+ * @param id Spectator id returned by spec_subscribe
+ */
+void spec_unsubscribe(SpecHub *hub, const uint32_t id);
+
+/**
+ * @brief Returns true while a spectator is subscribed, false once removed or
+ * evicted
+ *
+ * @param hub Pointer to the hub
+ * @param id Spectator id returned by spec_subscribe
+ */
+static inline bool spec_is_subscribed(const SpecHub *hub, const uint32_t id) {
+  return id < hub->capacity && hub->subs[id].fd >= 0;
+}
+
+/**
+ * @brief Queues one frame of a committed move to every spectator of its
+ * session
+ *
+ * Nothing is sent until spec_flush. Spectators with a full queue are evicted.
+ *
+ * @param hub Pointer to the hub
+ * @param record Journal record of the move, session must exist
+ * @param bb Pointer to the board after the move
+ * @return The number of spectators the frame was queued to.
+ */
+uint32_t spec_publish(SpecHub *hub, const WalRecord *record,
+                      const Bitboard *bb);
+
+/**
+ * @brief Sends the queued frames until every socket is empty or full
+ *
+ * Spectators whose socket fails are evicted.
+ *
+ * @param hub Pointer to the hub
+ * @return The number of spectators with frames still queued.
+ */
+uint32_t spec_flush(SpecHub *hub);
+
+/**
+ * @brief Returns the bytes held by the hub: slots, lists and frames
+ *
+ * @param hub Pointer to the hub
+ * @return The number of bytes.
+ */
+uint64_t spec_memory(const SpecHub *hub);
+
+// ----------------------------------------
+// Spectator functions
+// ----------------------------------------
+
+/**
+ * @brief Checks a received frame and fills a board with it for print_board
+ *
+ * @param wire Pointer to the frame
+ * @param board The board, filled in
+ * @return true if the frame is well formed, false otherwise.
+ */
+bool spec_decode(const SpecWire *wire, char board[ROWS][COLS]);
+
+#endif
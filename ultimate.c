@@ -0,0 +1,576 @@
+#include "ultimate.h"
+
+// Bit per 3x3 mask: set if the mask holds three in a row
+uint64_t ult_win_lut[(ULT_SUB_FULL + 1) / 64];
+
+// The 8 winning lines of a 3x3 grid
+static const uint16_t ult_lines[8] = {0x007, 0x038, 0x1C0, 0x049,
+                                      0x092, 0x124, 0x111, 0x054};
+
+// ----------------------------------------
+// Internal helpers
+// ----------------------------------------
+
+/*
+The function ult_cell returns the cell index of a 9x9 display row and column.
+*/
+static inline uint ult_cell(const uint row, const uint col) {
+  return (row / 3 * 3 + col / 3) * 9 + row % 3 * 3 + col % 3;
+}
+
+/*
+The function ult_rand is the xorshift32 generator of the engine.
+*/
+static inline uint32_t ult_rand(UltTree *tree) {
+  uint32_t r = tree->rng;
+  r ^= r << 13;
+  r ^= r >> 17;
+  r ^= r << 5;
+  tree->rng = r;
+  return r;
+}
+
+/*
+The function ult_nth_bit returns the index of the nth lowest set bit of mask.
+*/
+static inline uint ult_nth_bit(uint mask, uint n) {
+  while (n--) {
+    mask &= mask - 1;
+  }
+  return __builtin_ctz(mask);
+}
+
+/*
+The function ult_empty returns the empty cells of a sub-board.
+*/
+static inline uint ult_empty(const UltBoard *board, const uint sub) {
+  return ~(board->x[sub] | board->o[sub]) & ULT_SUB_FULL;
+}
+
+/*
+The function ult_next_cursor returns the first legal cell after cell in 9x9
+display order, wrapping around, or cell itself if there is none.
+*/
+static uint ult_next_cursor(const UltBoard *board, const uint cell) {
+  uint pos = ult_row(cell) * 9 + ult_col(cell);
+
+  for (uint step = 1; step <= ULT_CELLS; step++) {
+    uint next = (pos + step) % ULT_CELLS;
+    uint candidate = ult_cell(next / 9, next % 9);
+    if (ult_is_legal(board, candidate)) {
+      return candidate;
+    }
+  }
+  return cell;
+}
+
+/*
+The function ult_random_move returns a uniformly random legal move. When the
+target is a single sub-board this is one pick among its empty cells; otherwise
+the empty cells of every open sub-board are counted and the pick is located by
+walking the sub-boards.
+*/
+static uint ult_random_move(UltTree *tree, const UltBoard *board) {
+  // Forced sub-board
+  if (board->target != ULT_ANY) {
+    uint empty = ult_empty(board, board->target);
+    uint n = ult_rand(tree) % __builtin_popcount(empty);
+    return board->target * 9 + ult_nth_bit(empty, n);
+  }
+
+  // Count the empty cells of the open sub-boards
+  uint open = ~board->closed & ULT_SUB_FULL;
+  uint total = 0;
+  for (uint subs = open; subs != 0; subs &= subs - 1) {
+    total += __builtin_popcount(ult_empty(board, __builtin_ctz(subs)));
+  }
+
+  // Find the sub-board holding the chosen cell
+  uint n = ult_rand(tree) % total;
+  for (uint subs = open;; subs &= subs - 1) {
+    uint sub = __builtin_ctz(subs);
+    uint empty = ult_empty(board, sub);
+    uint count = __builtin_popcount(empty);
+    if (n < count) {
+      return sub * 9 + ult_nth_bit(empty, n);
+    }
+    n -= count;
+  }
+}
+
+/*
+The function ult_playout plays random legal moves until the game ends and
+returns the winner. The board is a one cache line copy, so every move is a bit
+set plus two table lookups.
+*/
+static char ult_playout(UltTree *tree, UltBoard board) {
+  while (!board.winner) {
+    ult_play(&board, ult_random_move(tree, &board));
+  }
+  return board.winner;
+}
+
+/*
+The function ult_move_count returns the number of legal moves, 0 once the game
+is over.
+*/
+static uint ult_move_count(const UltBoard *board) {
+  uint count = 0;
+  for (uint subs = ult_legal_subs(board); subs != 0; subs &= subs - 1) {
+    count += __builtin_popcount(ult_empty(board, __builtin_ctz(subs)));
+  }
+  return count;
+}
+
+/*
+The function ult_new_node takes the next node from the pool and links it as the
+first child of parent. Every legal move of the position starts untried.
+*/
+static uint16_t ult_new_node(UltTree *tree, const uint16_t parent,
+                             const uint move, const char player,
+                             const UltBoard *board) {
+  uint16_t index = tree->used++;
+  UltNode *node = &tree->pool[index];
+
+  node->visits = 0;
+  node->score = 0;
+  node->parent = parent;
+  node->first_child = MCTS_NONE;
+  node->next_sibling = MCTS_NONE;
+  node->move = move;
+  node->player = player;
+  node->winner = board->winner;
+  node->untried = ult_move_count(board);
+
+  // Link the node in front of the parent's children
+  if (parent != MCTS_NONE) {
+    node->next_sibling = tree->pool[parent].first_child;
+    tree->pool[parent].first_child = index;
+  }
+  return index;
+}
+
+/*
+The function ult_expand plays one untried move of the node, picked at random,
+on the board and adds its child, like the expansion of mcts_run. With up to 81
+moves a node keeps only the number of untried moves; the moves that already
+have a child are collected from its children instead.
+*/
+static uint16_t ult_expand(UltTree *tree, const uint16_t index,
+                           UltBoard *board) {
+  UltNode *node = &tree->pool[index];
+
+  // Mark the moves that already have a child
+  uint16_t tried[ULT_SUBS] = {0};
+  for (uint16_t child = node->first_child; child != MCTS_NONE;
+       child = tree->pool[child].next_sibling) {
+    uint move = tree->pool[child].move;
+    tried[move / 9] |= 1u << (move % 9);
+  }
+
+  // Find the chosen move among the untried ones, sub-board by sub-board
+  uint n = ult_rand(tree) % node->untried;
+  uint move = 0;
+  for (uint subs = ult_legal_subs(board);; subs &= subs - 1) {
+    uint sub = __builtin_ctz(subs);
+    uint untried = ult_empty(board, sub) & ~tried[sub];
+    uint count = __builtin_popcount(untried);
+    if (n < count) {
+      move = sub * 9 + ult_nth_bit(untried, n);
+      break;
+    }
+    n -= count;
+  }
+
+  node->untried--;
+  char player = board->to_move;
+  ult_play(board, move);
+  return ult_new_node(tree, index, move, player, board);
+}
+
+/*
+The function ult_select returns the child of parent with the highest UCT
+value.
+*/
+static uint16_t ult_select(const UltTree *tree, const uint16_t parent) {
+  uint32_t log_n = mcts_uct_log(tree->pool[parent].visits);
+
+  uint16_t best = MCTS_NONE;
+  uint64_t best_value = 0;
+
+  // Loop over the children of the parent
+  for (uint16_t child = tree->pool[parent].first_child; child != MCTS_NONE;
+       child = tree->pool[child].next_sibling) {
+    const UltNode *node = &tree->pool[child];
+    uint64_t value = mcts_uct_value(node->score, node->visits, log_n);
+    if (best == MCTS_NONE || value > best_value) {
+      best = child;
+      best_value = value;
+    }
+  }
+  return best;
+}
+
+// ----------------------------------------
+// Board functions
+// ----------------------------------------
+
+/*
+The function ult_init checks every 9 bit mask against the 8 lines once, so that
+a sub-board or meta-board win check is a single table lookup.
+*/
+void ult_init(void) {
+  for (uint mask = 0; mask <= ULT_SUB_FULL; mask++) {
+    for (uint l = 0; l < 8; l++) {
+      if ((mask & ult_lines[l]) == ult_lines[l]) {
+        ult_win_lut[mask >> 6] |= 1ull << (mask & 63);
+        break;
+      }
+    }
+  }
+}
+
+/*
+The function ult_clear empties every sub-board and the meta-board.
+*/
+void ult_clear(UltBoard *board) {
+  *board = (UltBoard){0};
+  board->target = ULT_ANY;
+  board->to_move = X;
+  board->cursor = ult_next_cursor(board, ult_cell(8, 8));
+}
+
+/*
+The function ult_legal_subs returns the target sub-board, or every sub-board
+that is not closed when the target is ULT_ANY.
+*/
+uint ult_legal_subs(const UltBoard *board) {
+  if (board->winner) {
+    return 0;
+  }
+  if (board->target != ULT_ANY) {
+    return 1u << board->target;
+  }
+  return ~board->closed & ULT_SUB_FULL;
+}
+
+/*
+The function ult_is_legal checks that the cell is inside an allowed sub-board
+and empty.
+*/
+bool ult_is_legal(const UltBoard *board, const uint cell) {
+  if (cell >= ULT_CELLS) {
+    return false;
+  }
+  return (ult_legal_subs(board) >> (cell / 9) & 1) &&
+         (ult_empty(board, cell / 9) >> (cell % 9) & 1);
+}
+
+/*
+The function ult_play sets the bit of the cell and updates the meta-board
+incrementally: only the sub-board that changed is checked, and the meta-board
+is only checked when that sub-board was won.
+*/
+void ult_play(UltBoard *board, const uint cell) {
+  uint sub = cell / 9;
+  uint local = cell % 9;
+  char player = board->to_move;
+
+  // Place the piece
+  uint16_t *mine = player == X ? &board->x[sub] : &board->o[sub];
+  *mine |= 1u << local;
+  board->moves++;
+
+  // Update the meta-board from the changed sub-board
+  if (ult_is_win(*mine)) {
+    uint16_t *meta = player == X ? &board->meta_x : &board->meta_o;
+    *meta |= 1u << sub;
+    board->closed |= 1u << sub;
+    if (ult_is_win(*meta)) {
+      board->winner = player;
+    }
+  } else if (ult_empty(board, sub) == 0) {
+    board->closed |= 1u << sub;
+  }
+
+  // Every sub-board closed without a meta-board win is a draw
+  if (!board->winner && board->closed == ULT_SUB_FULL) {
+    board->winner = EMPTY;
+  }
+
+  // The local cell picks the opponent's sub-board
+  board->target = board->closed >> local & 1 ? ULT_ANY : (int8_t)local;
+  board->to_move = player == X ? O : X;
+}
+
+/*
+The function ult_print_board prints the 9x9 board with the sub-boards
+separated by | and + lines and empty cells as '.', followed by the
+meta-board and the sub-board the next player must play in.
+*/
+void ult_print_board(const UltBoard *board) {
+  for (uint row = 0; row < 9; row++) {
+    // Print the separator line between sub-board rows
+    if (row == 3 || row == 6) {
+      printf("-------+-------+-------\n");
+    }
+
+    // Print the cells of the row
+    for (uint col = 0; col < 9; col++) {
+      uint cell = ult_cell(row, col);
+      uint bit = 1u << (cell % 9);
+      char c = board->x[cell / 9] & bit   ? X
+               : board->o[cell / 9] & bit ? O
+                                          : '.';
+      printf("%s%c", col == 3 || col == 6 ? " | " : " ", c);
+    }
+    printf("\n");
+  }
+
+  // Print the meta-board
+  for (uint row = 0; row < 3; row++) {
+    printf("Meta:");
+    for (uint col = 0; col < 3; col++) {
+      uint bit = 1u << (row * 3 + col);
+      printf(" %c", board->meta_x & bit   ? X
+                    : board->meta_o & bit ? O
+                    : board->closed & bit ? '#'
+                                          : '.');
+    }
+    printf("\n");
+  }
+
+  // Print the sub-board to play in
+  if (board->winner) {
+    return;
+  }
+  if (board->target == ULT_ANY) {
+    printf("Next sub-board: any\n");
+  } else {
+    printf("Next sub-board: row %d col %d\n", board->target / 3,
+           board->target % 3);
+  }
+}
+
+// ----------------------------------------
+// Button handle functions
+// ----------------------------------------
+
+/*
+The function ult_reset is reset_board for the ultimate board: it empties the
+board, prints it with the player to move and clears the winner LED on core1.
+*/
+void ult_reset(UltBoard *board) {
+  printf("Resetting the board\n");
+  ult_clear(board);
+  ult_print_board(board);
+  print_player_turn(board->to_move);
+  multicore_fifo_push_blocking(EMPTY);
+}
+
+/*
+The function ult_handle_btn1 is handle_btn1 for the ultimate board. With 81
+cells a plain step through every cell takes too many presses, so the cursor
+skips cells that are occupied or outside the allowed sub-boards. It prints the
+9x9 row and column of the new cursor.
+*/
+void ult_handle_btn1(UltBoard *board) {
+  board->cursor = ult_next_cursor(board, board->cursor);
+  print_curr_pos(ult_row(board->cursor), ult_col(board->cursor));
+}
+
+/*
+The function ult_handle_btn2 is handle_btn2 for the ultimate board:
+  - If the cursor cell is not a legal move it prints an error and returns.
+  - Plays the cell and prints the board.
+  - On a win it pushes the winner to core1 and waits for the reset button.
+  - On a draw it prints a message and resets the board.
+  - Otherwise it moves the cursor to the first legal cell and prints the turn
+of the next player.
+*/
+void ult_handle_btn2(UltBoard *board) {
+  uint cell = board->cursor;
+  char player = board->to_move;
+
+  // Check the move
+  if (!ult_is_legal(board, cell)) {
+    printf("row %u col %u is not a legal move\n", ult_row(cell), ult_col(cell));
+    printf("Please select another location.\n");
+    return;
+  }
+
+  // Play the move and print the board
+  ult_play(board, cell);
+  ult_print_board(board);
+
+  // Check if the game is over
+  if (board->winner == player) {
+    printf("Player %c wins!\n", player);
+    multicore_fifo_push_blocking(player);
+    printf("Please press reset button to start the game.\n");
+    printf("Waiting for the reset ...\n");
+  } else if (board->winner == EMPTY) {
+    printf("Tie game!\n");
+    ult_reset(board);
+  } else {
+    board->cursor = ult_next_cursor(board, ult_cell(8, 8));
+    print_player_turn(board->to_move);
+  }
+}
+
+// ----------------------------------------
+// Engine functions
+// ----------------------------------------
+
+/*
+The function ult_search_init empties the node pool and creates the root node,
+owned by the player who moved last.
+*/
+void ult_search_init(UltTree *tree, const UltBoard *root, const uint32_t seed) {
+  // Reset the pool and the statistics
+  tree->used = 0;
+  tree->root = *root;
+  tree->rng = seed ? seed : 1;
+  tree->iterations = 0;
+  tree->playouts = 0;
+  tree->elapsed_us = 0;
+  tree->pool_full = 0;
+
+  // Create the root node
+  ult_new_node(tree, MCTS_NONE, 0, root->to_move == X ? O : X, root);
+}
+
+/*
+The function ult_run runs UCT iterations like mcts_run: every iteration adds
+at most one node, the child of one untried move, so the pool grows with the
+iterations and not with the 81 possible moves. When the pool is full the search
+keeps going from the leaves without expanding.
+*/
+void ult_run(UltTree *tree, const uint32_t iterations) {
+  uint64_t start_us = time_us_64();
+
+  for (uint32_t i = 0; i < iterations; i++) {
+    UltBoard board = tree->root;
+    uint16_t index = 0;
+    UltNode *node = &tree->pool[0];
+
+    // Selection
+    while (node->untried == 0 && node->first_child != MCTS_NONE) {
+      index = ult_select(tree, index);
+      node = &tree->pool[index];
+      ult_play(&board, node->move);
+    }
+
+    // Expansion
+    if (node->untried != 0) {
+      if (tree->used < ULT_POOL_SIZE) {
+        index = ult_expand(tree, index, &board);
+        node = &tree->pool[index];
+      } else {
+        tree->pool_full++;
+      }
+    }
+
+    // Simulation
+    char winner = node->winner;
+    if (!winner) {
+      winner = ult_playout(tree, board);
+      tree->playouts++;
+    }
+
+    // Backpropagation
+    while (index != MCTS_NONE) {
+      node = &tree->pool[index];
+      node->visits++;
+      node->score += winner == node->player ? 2 : winner == EMPTY ? 1 : 0;
+      index = node->parent;
+    }
+    tree->iterations++;
+  }
+
+  tree->elapsed_us += time_us_64() - start_us;
+}
+
+/*
+The function ult_best_move returns the move of the root child with the most
+visits.
+*/
+int ult_best_move(const UltTree *tree) {
+  int best = -1;
+  uint32_t best_visits = 0;
+
+  // Loop over the children of the root
+  for (uint16_t child = tree->pool[0].first_child; child != MCTS_NONE;
+       child = tree->pool[child].next_sibling) {
+    if (tree->pool[child].visits > best_visits) {
+      best = tree->pool[child].move;
+      best_visits = tree->pool[child].visits;
+    }
+  }
+  return best;
+}
+
+/*
+The function ult_search runs the search in batches of MCTS_CHECK_INTERVAL
+iterations and checks the budget between batches, like mcts_search.
+*/
+int ult_search(UltTree *tree, const UltBoard *root, const MctsBudget budget,
+               const uint32_t seed) {
+  ult_search_init(tree, root, seed);
+
+  // Nothing to search if the game is already over
+  if (root->winner) {
+    return -1;
+  }
+
+  while (true) {
+    // Do not run past the iteration budget
+    uint32_t batch = MCTS_CHECK_INTERVAL;
+    if (budget.max_iterations != 0) {
+      if (tree->iterations >= budget.max_iterations) {
+        break;
+      }
+      if (budget.max_iterations - tree->iterations < batch) {
+        batch = budget.max_iterations - tree->iterations;
+      }
+    }
+
+    ult_run(tree, batch);
+
+    // Stop when the time budget is spent
+    if (budget.max_us != 0 && tree->elapsed_us >= budget.max_us) {
+      break;
+    }
+    // Stop when neither limit is set, one batch is all we can do
+    if (budget.max_iterations == 0 && budget.max_us == 0) {
+      break;
+    }
+  }
+
+  return ult_best_move(tree);
+}
+
+/*
+The function ult_engine_move puts the cursor on the cell chosen by the engine
+and plays it through ult_handle_btn2, so the engine's move is printed and
+checked exactly like a button press.
+*/
+void ult_engine_move(UltBoard *board, const uint cell) {
+  board->cursor = cell;
+  print_curr_pos(ult_row(cell), ult_col(cell));
+  ult_handle_btn2(board);
+}
+
+/*
+The function ult_print_stats prints the iteration and playout counts, the node
+pool usage and the playout rate.
+*/
+void ult_print_stats(const UltTree *tree) {
+  printf("Ultimate: %lu iterations, %lu playouts in %llu us, %u/%u nodes\n",
+         (unsigned long)tree->iterations, (unsigned long)tree->playouts,
+         (unsigned long long)tree->elapsed_us, tree->used, ULT_POOL_SIZE);
+  if (tree->elapsed_us > 0) {
+    printf("Ultimate: %llu playouts/s\n",
+           (unsigned long long)tree->playouts * 1000000ull / tree->elapsed_us);
+  }
+}
@@ -0,0 +1,273 @@
+#ifndef __ULTIMATE_H__
+#define __ULTIMATE_H__
+
+#include "game.h"
+#include "mcts.h"
+#include <stdint.h>
+
+// Ultimate tic-tac-toe: a 3x3 meta-board of 3x3 sub-boards. The cell a player
+// picks inside a sub-board sends the opponent to the sub-board at the same
+// position; a sub-board that is won or full is closed, and being sent to a
+// closed sub-board allows a move in any open one. Three sub-boards in a row on
+// the meta-board win the game.
+//
+// Cells are numbered sub * 9 + local, where sub and local are both
+// row * 3 + col inside their 3x3 grid. The 9x9 display row and column are
+// computed by ult_row and ult_col.
+
+#define ULT_SUBS 9                    // Number of sub-boards
+#define ULT_CELLS (ULT_SUBS * 9)      // Number of cells
+#define ULT_SUB_FULL 0x1FF            // Mask of the 9 cells of a sub-board
+#define ULT_ANY -1                    // Target when any open sub-board is allowed
+#ifndef ULT_POOL_SIZE
+#define ULT_POOL_SIZE 2048            // Number of tree nodes of the engine
+#endif
+#ifndef ULT_ENGINE_PLAYER
+#define ULT_ENGINE_PLAYER O           // Player moved by the engine, 0 for none
+#endif
+#ifndef ULT_ENGINE_US
+#define ULT_ENGINE_US 1000000         // Engine thinking time in microseconds
+#endif
+
+_Static_assert(ULT_POOL_SIZE < MCTS_NONE, "node indices are 16 bits");
+
+// Struct for storing an ultimate board, sized and aligned to one cache line so
+// that copying it for a playout is a single line fill
+// @field x cells occupied by X in each sub-board, bit index is local
+// @field o cells occupied by O in each sub-board, bit index is local
+// @field meta_x sub-boards won by X
+// @field meta_o sub-boards won by O
+// @field closed sub-boards that are won or full
+// @field target sub-board the player to move must play in, or ULT_ANY
+// @field to_move player to move
+// @field winner winner of the game (X, O, EMPTY for a draw) or 0 if the game
+// goes on
+// @field moves number of pieces on the board
+// @field cursor cell selected with BTN1
+typedef struct __attribute__((aligned(64))) {
+  uint16_t x[ULT_SUBS];
+  uint16_t o[ULT_SUBS];
+  uint16_t meta_x;
+  uint16_t meta_o;
+  uint16_t closed;
+  int8_t target;
+  char to_move;
+  char winner;
+  uint8_t moves;
+  uint8_t cursor;
+  uint8_t reserved[17];
+} UltBoard;
+
+_Static_assert(sizeof(UltBoard) == 64, "UltBoard fills one cache line");
+
+// Struct for storing one engine tree node
+// @field visits number of playouts that went through this node
+// @field score playout results for the player who moved into this node, in
+// half points
+// @field parent index of the parent node
+// @field first_child index of the first child node
+// @field next_sibling index of the next child of the same parent
+// @field move cell played to reach this node
+// @field player player who played move
+// @field winner winner of the position or 0 if the game goes on
+// @field untried number of legal moves that have no child node yet
+typedef struct {
+  uint32_t visits;
+  uint32_t score;
+  uint16_t parent;
+  uint16_t first_child;
+  uint16_t next_sibling;
+  uint8_t move;
+  char player;
+  char winner;
+  uint8_t untried;
+} UltNode;
+
+// Struct for storing the engine search tree and its node pool
+// @field pool fixed node pool, node 0 is the root
+// @field used number of nodes taken from the pool
+// @field root position at the root of the tree
+// @field rng state of the xorshift random generator
+// @field iterations number of iterations run so far
+// @field playouts number of random playouts run so far
+// @field elapsed_us time spent in ult_run so far
+// @field pool_full number of expansions skipped because the pool was full
+typedef struct {
+  UltNode pool[ULT_POOL_SIZE];
+  uint16_t used;
+  UltBoard root;
+  uint32_t rng;
+  uint32_t iterations;
+  uint32_t playouts;
+  uint64_t elapsed_us;
+  uint32_t pool_full;
+} UltTree;
+
+// Bit per 3x3 mask: set if the mask holds three in a row, filled by ult_init
+extern uint64_t ult_win_lut[(ULT_SUB_FULL + 1) / 64];
+
+// ----------------------------------------
+// Board functions
+// ----------------------------------------
+
+/**
+ * @brief Builds the 3x3 win lookup; must be called once before any other
+ * ultimate function
+ */
+void ult_init(void);
+
+/**
+ * @brief Returns whether a 3x3 mask holds three in a row
+ *
+ * @param mask Cells of one player in a sub-board, or sub-boards won on the
+ * meta-board
+ * @return true if the mask wins, false otherwise.
+ */
+static inline bool ult_is_win(const uint mask) {
+  return (ult_win_lut[mask >> 6] >> (mask & 63)) & 1;
+}
+
+/**
+ * @brief Returns the 9x9 display row of a cell
+ *
+ * @param cell Cell index
+ * @return The row, 0 to 8.
+ */
+static inline uint ult_row(const uint cell) {
+  return cell / 27 * 3 + cell % 9 / 3;
+}
+
+/**
+ * @brief Returns the 9x9 display column of a cell
+ *
+ * @param cell Cell index
+ * @return The column, 0 to 8.
+ */
+static inline uint ult_col(const uint cell) {
+  return cell / 9 % 3 * 3 + cell % 3;
+}
+
+/**
+ * @brief Empties the board, X moves first in any sub-board
+ *
+ * @param board Pointer to the board
+ */
+void ult_clear(UltBoard *board);
+
+/**
+ * @brief Returns the sub-boards the player to move may play in
+ *
+ * @param board Pointer to the board
+ * @return Mask of the allowed sub-boards, 0 if the game is over.
+ */
+uint ult_legal_subs(const UltBoard *board);
+
+/**
+ * @brief Returns whether the player to move may play a cell
+ *
+ * @param board Pointer to the board
+ * @param cell Cell index
+ * @return true if the move is legal, false otherwise.
+ */
+bool ult_is_legal(const UltBoard *board, const uint cell);
+
+/**
+ * @brief Plays a legal move for the player to move
+ *
+ * The sub-board, the meta-board, the target and the winner are updated from
+ * the cell that changed only.
+ *
+ * @param board Pointer to the board
+ * @param cell Cell index of a legal move
+ */
+void ult_play(UltBoard *board, const uint cell);
+
+/**
+ * @brief Prints the 9x9 board and the sub-board to play in
+ *
+ * @param board Pointer to the board
+ */
+void ult_print_board(const UltBoard *board);
+
+// ----------------------------------------
+// Button handle functions
+// ----------------------------------------
+
+/**
+ * @brief Resets the board, prints it and clears the winner LED
+ *
+ * @param board Pointer to the board
+ */
+void ult_reset(UltBoard *board);
+
+/**
+ * @brief Handle button 1 press: moves the cursor to the next legal cell
+ *
+ * @param board Pointer to the board
+ */
+void ult_handle_btn1(UltBoard *board);
+
+/**
+ * @brief Handle button 2 press: plays the cell under the cursor
+ *
+ * @param board Pointer to the board
+ */
+void ult_handle_btn2(UltBoard *board);
+
+// ----------------------------------------
+// Engine functions
+// ----------------------------------------
+
+/**
+ * @brief Starts a new search tree for a position
+ *
+ * @param tree Pointer to the search tree
+ * @param root The position to search
+ * @param seed Seed of the random generator
+ */
+void ult_search_init(UltTree *tree, const UltBoard *root, const uint32_t seed);
+
+/**
+ * @brief Runs a number of UCT iterations on the tree
+ *
+ * @param tree Pointer to the search tree
+ * @param iterations Number of iterations to run
+ */
+void ult_run(UltTree *tree, const uint32_t iterations);
+
+/**
+ * @brief Returns the most visited move of the root
+ *
+ * @param tree Pointer to the search tree
+ * @return The cell index of the best move found so far, or -1 if there is none.
+ */
+int ult_best_move(const UltTree *tree);
+
+/**
+ * @brief Searches a position until the budget expires
+ *
+ * @param tree Pointer to the search tree
+ * @param root The position to search
+ * @param budget The iteration and time budget
+ * @param seed Seed of the random generator
+ * @return The cell index of the best move found, or -1 if there is none.
+ */
+int ult_search(UltTree *tree, const UltBoard *root, const MctsBudget budget,
+               const uint32_t seed);
+
+/**
+ * @brief Plays the move chosen by the engine, as if BTN2 was pressed on it
+ *
+ * @param board Pointer to the board
+ * @param cell Cell index returned by the search
+ */
+void ult_engine_move(UltBoard *board, const uint cell);
+
+/**
+ * @brief Prints the iteration count, node usage and playouts per second
+ *
+ * @param tree Pointer to the search tree
+ */
+void ult_print_stats(const UltTree *tree);
+
+#endif
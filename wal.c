@@ -0,0 +1,874 @@
+#include "wal.h"
+#include "bitboard.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Records in front of every batch buffer that hold its WalBatch header, so a
+// batch is written with a single write
+#define WAL_HEADER_RECORDS (sizeof(WalBatch) / sizeof(WalRecord))
+
+_Static_assert(sizeof(WalBatch) % sizeof(WalRecord) == 0,
+               "the batch header fills whole records");
+
+// CRC-32 (IEEE) lookup, filled by wal_init
+static uint32_t crc_table[256];
+
+// Struct for storing a file mapped read-only
+// @field data start of the mapping, NULL if the file is empty
+// @field size size of the file in bytes
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+} WalMap;
+
+// Struct for storing the journal files found in the directory
+// @field segments generations of the segments to replay, ascending
+// @field segment_count number of segments to replay
+// @field snapshot generation of the newest snapshot, 0 if none
+// @field max_generation highest generation of any file, 0 if none
+typedef struct {
+  uint32_t *segments;
+  uint32_t segment_count;
+  uint32_t snapshot;
+  uint32_t max_generation;
+} WalDir;
+
+// Struct for storing one batch found in a segment
+// @field batch pointer to the batch inside the mapped segment
+// @field segment index of the segment in WalDir.segments
+typedef struct {
+  const WalBatch *batch;
+  uint32_t segment;
+} WalFound;
+
+// Struct for storing the state shared by the recovery threads
+// @field sessions the session table
+// @field count number of sessions in the table
+// @field threads number of threads
+// @field entries snapshot entries, sorted by session
+// @field entry_count number of snapshot entries
+// @field batches batches found in the segments, in journal order
+// @field batch_count number of batches found
+// @field segment_end per segment, index of the first batch not to replay
+// @field start_lock held by wal_recover until the threads are started
+// @field barrier separates the checksum pass from the replay pass
+// @field bad set when a record does not fit the table
+typedef struct {
+  WalSession *sessions;
+  uint32_t count;
+  uint threads;
+  const WalSnapEntry *entries;
+  uint32_t entry_count;
+  const WalFound *batches;
+  uint64_t batch_count;
+  uint64_t *segment_end;
+  pthread_mutex_t start_lock;
+  pthread_barrier_t barrier;
+  bool bad;
+} WalReplay;
+
+// Struct for storing one recovery thread
+// @field replay shared state
+// @field index index of the thread, selects its sessions and batches
+// @field thread the thread
+typedef struct {
+  WalReplay *replay;
+  uint index;
+  pthread_t thread;
+} WalWorker;
+
+// ----------------------------------------
+// Internal helpers
+// ----------------------------------------
+
+/*
+The function wal_ns reads the monotonic clock in nanoseconds.
+*/
+static uint64_t wal_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+The function wal_crc computes the CRC-32 of size bytes.
+*/
+static uint32_t wal_crc(const void *data, const size_t size) {
+  const uint8_t *bytes = data;
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t i = 0; i < size; i++) {
+    crc = crc_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+/*
+The function wal_write_all writes size bytes, retrying short writes.
+*/
+static bool wal_write_all(const int fd, const void *data, size_t size) {
+  const uint8_t *bytes = data;
+  while (size > 0) {
+    ssize_t written = write(fd, bytes, size);
+    if (written <= 0) {
+      return false;
+    }
+    bytes += written;
+    size -= written;
+  }
+  return true;
+}
+
+/*
+The function wal_sync_dir makes the files created or renamed in the directory
+durable.
+*/
+static bool wal_sync_dir(const char *dir) {
+  int fd = open(dir, O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = fsync(fd) == 0;
+  close(fd);
+  return ok;
+}
+
+/*
+The function wal_parse_name reads the generation of a file named prefix
+followed by a decimal number.
+*/
+static bool wal_parse_name(const char *name, const char *prefix,
+                           uint32_t *gen) {
+  size_t length = strlen(prefix);
+  if (strncmp(name, prefix, length) != 0 || name[length] < '0' ||
+      name[length] > '9') {
+    return false;
+  }
+  char *end;
+  unsigned long value = strtoul(name + length, &end, 10);
+  if (*end != '\0' || value == 0 || value > UINT32_MAX) {
+    return false;
+  }
+  *gen = value;
+  return true;
+}
+
+/*
+The function wal_compare_u32 orders generations for qsort.
+*/
+static int wal_compare_u32(const void *a, const void *b) {
+  uint32_t ua = *(const uint32_t *)a;
+  uint32_t ub = *(const uint32_t *)b;
+  return ua < ub ? -1 : ua > ub;
+}
+
+/*
+The function wal_read_dir lists the journal files. The segments older than the
+newest snapshot are already in it and are left out.
+*/
+static bool wal_read_dir(const char *dir, WalDir *found) {
+  DIR *d = opendir(dir);
+  if (d == NULL) {
+    return false;
+  }
+
+  // Find the newest snapshot and every segment
+  uint32_t capacity = 0;
+  *found = (WalDir){0};
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL) {
+    uint32_t gen;
+    if (wal_parse_name(e->d_name, "snap.", &gen)) {
+      if (gen > found->snapshot) {
+        found->snapshot = gen;
+      }
+    } else if (wal_parse_name(e->d_name, "wal.", &gen)) {
+      if (found->segment_count == capacity) {
+        capacity = capacity ? capacity * 2 : 16;
+        found->segments =
+            realloc(found->segments, capacity * sizeof(uint32_t));
+      }
+      found->segments[found->segment_count++] = gen;
+    } else {
+      continue;
+    }
+    if (gen > found->max_generation) {
+      found->max_generation = gen;
+    }
+  }
+  closedir(d);
+
+  // Keep the segments from the snapshot on, in order
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < found->segment_count; i++) {
+    if (found->segments[i] >= found->snapshot) {
+      found->segments[kept++] = found->segments[i];
+    }
+  }
+  found->segment_count = kept;
+  if (kept > 0) {
+    qsort(found->segments, kept, sizeof(uint32_t), wal_compare_u32);
+  }
+  return true;
+}
+
+/*
+The function wal_remove_older deletes the segments and snapshots older than
+generation, which the snapshot of generation replaces.
+*/
+static void wal_remove_older(const char *dir, const uint32_t generation) {
+  DIR *d = opendir(dir);
+  if (d == NULL) {
+    return;
+  }
+
+  char path[512];
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL) {
+    uint32_t gen;
+    if ((wal_parse_name(e->d_name, "wal.", &gen) ||
+         wal_parse_name(e->d_name, "snap.", &gen)) &&
+        gen < generation) {
+      snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+      unlink(path);
+    }
+  }
+  closedir(d);
+}
+
+/*
+The function wal_map maps a whole file read-only. An empty file gives an empty
+mapping.
+*/
+static bool wal_map(const char *path, WalMap *map) {
+  *map = (WalMap){NULL, 0};
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0;
+  if (ok && st.st_size > 0) {
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ok = data != MAP_FAILED;
+    if (ok) {
+      madvise(data, st.st_size, MADV_SEQUENTIAL);
+      map->data = data;
+      map->size = st.st_size;
+    }
+  }
+  close(fd);
+  return ok;
+}
+
+/*
+The function wal_unmap releases a mapping made by wal_map.
+*/
+static void wal_unmap(WalMap *map) {
+  if (map->data != NULL) {
+    munmap((void *)map->data, map->size);
+  }
+  *map = (WalMap){NULL, 0};
+}
+
+/*
+The function wal_open_segment creates the segment of a generation and makes
+its directory entry durable.
+*/
+static int wal_open_segment(const char *dir, const uint32_t generation) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/wal.%lu", dir, (unsigned long)generation);
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (fd >= 0 && !wal_sync_dir(dir)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/*
+The function wal_flusher is the group commit loop. It takes the whole batch
+filled so far, so the appenders keep filling the other buffer while the batch
+is written, then writes it with one write and one fdatasync and wakes up the
+clients waiting for its records.
+*/
+static void *wal_flusher(void *arg) {
+  WalLog *log = arg;
+
+  pthread_mutex_lock(&log->lock);
+  while (true) {
+    // Wait for records
+    while (log->fill_count == 0 && !log->stop) {
+      pthread_cond_wait(&log->filled, &log->lock);
+    }
+    if (log->fill_count == 0) {
+      break;
+    }
+
+    // Take the batch and let the appenders fill the other buffer
+    WalRecord *buffer = log->buffers[log->fill];
+    uint32_t count = log->fill_count;
+    uint64_t first_ns = log->fill_first_ns;
+    uint64_t sum_ns = log->fill_sum_ns;
+    uint64_t first_seq = log->appended_seq - count + 1;
+    int fd = log->fd;
+    bool failed = log->failed;
+    log->fill ^= 1;
+    log->fill_count = 0;
+    log->fill_sum_ns = 0;
+    pthread_cond_broadcast(&log->synced);
+    pthread_mutex_unlock(&log->lock);
+
+    // Write the header and the records, then sync the data
+    WalBatch *header = (WalBatch *)buffer;
+    *header = (WalBatch){.magic = WAL_MAGIC,
+                         .count = count,
+                         .first_seq = first_seq,
+                         .crc = wal_crc(buffer + WAL_HEADER_RECORDS,
+                                        count * sizeof(WalRecord))};
+    size_t size = (WAL_HEADER_RECORDS + count) * sizeof(WalRecord);
+    uint64_t start = wal_ns();
+    bool ok = !failed && wal_write_all(fd, buffer, size) && fdatasync(fd) == 0;
+    uint64_t end = wal_ns();
+
+    // Publish the durable records
+    pthread_mutex_lock(&log->lock);
+    if (ok) {
+      log->durable_seq = first_seq + count - 1;
+      log->stats.records += count;
+      log->stats.commits++;
+      log->stats.bytes += size;
+      log->stats.sync_ns += end - start;
+      log->stats.latency_ns += count * end - sum_ns;
+      if (end - first_ns > log->stats.max_latency_ns) {
+        log->stats.max_latency_ns = end - first_ns;
+      }
+      if (count > log->stats.max_batch) {
+        log->stats.max_batch = count;
+      }
+    } else {
+      log->failed = true;
+    }
+    pthread_cond_broadcast(&log->synced);
+  }
+  pthread_mutex_unlock(&log->lock);
+  return NULL;
+}
+
+/*
+The function wal_snap_load copies a snapshot entry into its session.
+*/
+static void wal_snap_load(WalSession *session, const WalSnapEntry *entry) {
+  Bitboard bb = {entry->x, entry->o};
+  bb_to_board(&bb, session->board);
+  session->current_player = entry->current_player;
+  session->moves = entry->moves;
+  session->is_game_over = entry->is_game_over;
+}
+
+/*
+The function wal_replay_thread rebuilds one range of the session table:
+  - The sessions of the range are reset, then loaded from the snapshot.
+  - The checksums of one slice of the batches are checked; a bad batch ends
+    the replay of its segment for every thread.
+  - After the barrier, the records of the range are replayed in journal order.
+Every thread reads the whole journal but touches its own sessions only, so
+the threads need no locks and the order of the moves of a session is kept.
+*/
+static void *wal_replay_thread(void *arg) {
+  WalWorker *worker = arg;
+  WalReplay *r = worker->replay;
+
+  // Wait until wal_recover knows how many threads it could start
+  pthread_mutex_lock(&r->start_lock);
+  pthread_mutex_unlock(&r->start_lock);
+
+  uint32_t lo = (uint64_t)r->count * worker->index / r->threads;
+  uint32_t hi = (uint64_t)r->count * (worker->index + 1) / r->threads;
+  bool last = worker->index == r->threads - 1;
+
+  // Reset the sessions of the range
+  for (uint32_t s = lo; s < hi; s++) {
+    wal_session_reset(&r->sessions[s]);
+  }
+
+  // Load the snapshot entries of the range, found by binary search
+  uint32_t first = 0;
+  uint32_t end = r->entry_count;
+  while (first < end) {
+    uint32_t mid = first + (end - first) / 2;
+    if (r->entries[mid].session < lo) {
+      first = mid + 1;
+    } else {
+      end = mid;
+    }
+  }
+  for (uint32_t i = first; i < r->entry_count && r->entries[i].session < hi;
+       i++) {
+    wal_snap_load(&r->sessions[r->entries[i].session], &r->entries[i]);
+  }
+
+  // Check the checksums of a slice of the batches
+  uint64_t b0 = r->batch_count * worker->index / r->threads;
+  uint64_t b1 = r->batch_count * (worker->index + 1) / r->threads;
+  for (uint64_t b = b0; b < b1; b++) {
+    const WalBatch *batch = r->batches[b].batch;
+    if (wal_crc(batch + 1, batch->count * sizeof(WalRecord)) == batch->crc) {
+      continue;
+    }
+    uint64_t *seg_end = &r->segment_end[r->batches[b].segment];
+    uint64_t cur = __atomic_load_n(seg_end, __ATOMIC_RELAXED);
+    while (b < cur && !__atomic_compare_exchange_n(seg_end, &cur, b, false,
+                                                    __ATOMIC_RELAXED,
+                                                    __ATOMIC_RELAXED)) {
+    }
+  }
+  pthread_barrier_wait(&r->barrier);
+
+  // Replay the records of the range
+  for (uint64_t b = 0; b < r->batch_count; b++) {
+    if (b >= r->segment_end[r->batches[b].segment]) {
+      continue;
+    }
+    const WalBatch *batch = r->batches[b].batch;
+    const WalRecord *records = (const WalRecord *)(batch + 1);
+    for (uint32_t i = 0; i < batch->count; i++) {
+      const WalRecord *rec = &records[i];
+      if (rec->session >= lo && rec->session < hi) {
+        if ((rec->type != WAL_MOVE && rec->type != WAL_RESET) ||
+            (rec->type == WAL_MOVE && rec->cell >= ROWS * COLS)) {
+          r->bad = true;
+          continue;
+        }
+        wal_session_apply(&r->sessions[rec->session], rec);
+      } else if (last && rec->session >= r->count) {
+        r->bad = true;
+      }
+    }
+  }
+  return NULL;
+}
+
+// ----------------------------------------
+// Session functions
+// ----------------------------------------
+
+/*
+The function wal_init fills the lookup of the reflected CRC-32 polynomial.
+*/
+void wal_init(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+    }
+    crc_table[i] = crc;
+  }
+}
+
+/*
+The function wal_session_reset sets a session to the state of reset_board,
+without the printing and the LED update.
+*/
+void wal_session_reset(WalSession *session) {
+  memset(session, 0, sizeof(*session));
+  memset(session->board, EMPTY, sizeof(session->board));
+  session->current_player = X;
+  session->moves = 0;
+  session->is_game_over = false;
+}
+
+/*
+The function wal_session_apply replays a record. A move is entered with
+place_piece at the cursor position of the cell, then the turn passes to the
+other player unless the move won the game, as in handle_btn2.
+*/
+void wal_session_apply(WalSession *session, const WalRecord *record) {
+  if (record->type == WAL_RESET) {
+    wal_session_reset(session);
+    return;
+  }
+
+  place_piece(record->player, record->cell, session->board);
+  session->moves = 0;
+  session->is_game_over = record->flags & WAL_GAME_OVER;
+  if (session->is_game_over) {
+    session->current_player = record->player;
+  } else {
+    session->current_player = record->player == X ? O : X;
+  }
+}
+
+// ----------------------------------------
+// Journal functions
+// ----------------------------------------
+
+/*
+The function wal_open allocates the two batch buffers, creates the segment and
+starts the flusher thread.
+*/
+bool wal_open(WalLog *log, const char *dir, const uint32_t generation) {
+  memset(log, 0, sizeof(*log));
+  if (strlen(dir) >= sizeof(log->dir)) {
+    return false;
+  }
+  strcpy(log->dir, dir);
+  log->generation = generation ? generation : 1;
+
+  // Create the segment
+  log->fd = wal_open_segment(dir, log->generation);
+  if (log->fd < 0) {
+    return false;
+  }
+
+  // Allocate the batch buffers, each with room for the header in front
+  size_t size = (WAL_HEADER_RECORDS + WAL_BATCH_RECORDS) * sizeof(WalRecord);
+  log->buffers[0] = malloc(size);
+  log->buffers[1] = malloc(size);
+  if (log->buffers[0] == NULL || log->buffers[1] == NULL) {
+    free(log->buffers[0]);
+    free(log->buffers[1]);
+    close(log->fd);
+    return false;
+  }
+
+  // Start the flusher
+  pthread_mutex_init(&log->lock, NULL);
+  pthread_cond_init(&log->filled, NULL);
+  pthread_cond_init(&log->synced, NULL);
+  if (pthread_create(&log->flusher, NULL, wal_flusher, log) != 0) {
+    free(log->buffers[0]);
+    free(log->buffers[1]);
+    close(log->fd);
+    return false;
+  }
+  return true;
+}
+
+/*
+The function wal_append copies the record into the batch being filled. The
+append time is kept per batch as a sum, so the flusher can add up the commit
+latency of every record without a timestamp per record.
+*/
+uint64_t wal_append(WalLog *log, const WalRecord *record) {
+  uint64_t now = wal_ns();
+
+  pthread_mutex_lock(&log->lock);
+  // Wait for room, the previous batch is still being written
+  while (log->fill_count == WAL_BATCH_RECORDS && !log->failed) {
+    pthread_cond_wait(&log->synced, &log->lock);
+  }
+  if (log->failed) {
+    pthread_mutex_unlock(&log->lock);
+    return 0;
+  }
+
+  // Add the record, the first one of a batch wakes the flusher up
+  log->buffers[log->fill][WAL_HEADER_RECORDS + log->fill_count++] = *record;
+  if (log->fill_count == 1) {
+    log->fill_first_ns = now;
+    pthread_cond_signal(&log->filled);
+  }
+  log->fill_sum_ns += now;
+  uint64_t seq = ++log->appended_seq;
+  pthread_mutex_unlock(&log->lock);
+  return seq;
+}
+
+/*
+The function wal_wait sleeps until the flusher has synced the record.
+*/
+bool wal_wait(WalLog *log, const uint64_t seq) {
+  pthread_mutex_lock(&log->lock);
+  while (log->durable_seq < seq && !log->failed) {
+    pthread_cond_wait(&log->synced, &log->lock);
+  }
+  bool ok = log->durable_seq >= seq;
+  pthread_mutex_unlock(&log->lock);
+  return ok;
+}
+
+/*
+The function wal_snapshot waits for the journal to be fully on disk, moves it
+to a new segment and writes the active sessions (those that differ from a reset
+board) to a temporary file. The file is synced and renamed, so a crash leaves
+either the old or the new snapshot, never half of one. A crash before the
+rename replays the old snapshot and both segments instead.
+*/
+bool wal_snapshot(WalLog *log, const WalSession *sessions,
+                  const uint32_t count) {
+  // Wait for the last batch and move to a new segment
+  pthread_mutex_lock(&log->lock);
+  while (log->durable_seq < log->appended_seq && !log->failed) {
+    pthread_cond_wait(&log->synced, &log->lock);
+  }
+  int fd = log->failed ? -1 : wal_open_segment(log->dir, log->generation + 1);
+  if (fd >= 0) {
+    close(log->fd);
+    log->fd = fd;
+    log->generation++;
+  }
+  uint32_t generation = log->generation;
+  pthread_mutex_unlock(&log->lock);
+  if (fd < 0) {
+    return false;
+  }
+
+  // Collect the active sessions
+  WalSnapEntry *entries = malloc((count ? count : 1) * sizeof(WalSnapEntry));
+  if (entries == NULL) {
+    return false;
+  }
+  WalSession empty;
+  wal_session_reset(&empty);
+  uint32_t entry_count = 0;
+  for (uint32_t s = 0; s < count; s++) {
+    const WalSession *session = &sessions[s];
+    if (session->current_player == X && !session->is_game_over &&
+        session->moves == 0 &&
+        memcmp(session->board, empty.board, sizeof(empty.board)) == 0) {
+      continue;
+    }
+    Bitboard bb;
+    bb_from_board((const char(*)[COLS])session->board, &bb);
+    entries[entry_count++] =
+        (WalSnapEntry){.session = s,
+                       .current_player = session->current_player,
+                       .moves = session->moves,
+                       .is_game_over = session->is_game_over,
+                       .x = bb.x,
+                       .o = bb.o};
+  }
+
+  // Write the temporary file
+  WalSnapHeader header = {.magic = WAL_SNAP_MAGIC,
+                          .version = WAL_VERSION,
+                          .rows = ROWS,
+                          .cols = COLS,
+                          .generation = generation,
+                          .entry_count = entry_count,
+                          .crc = wal_crc(entries,
+                                         entry_count * sizeof(WalSnapEntry))};
+  char tmp_path[512];
+  char path[512];
+  snprintf(tmp_path, sizeof(tmp_path), "%s/snap.tmp", log->dir);
+  snprintf(path, sizeof(path), "%s/snap.%lu", log->dir,
+           (unsigned long)generation);
+  int snap_fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool ok = snap_fd >= 0 && wal_write_all(snap_fd, &header, sizeof(header)) &&
+            wal_write_all(snap_fd, entries,
+                          entry_count * sizeof(WalSnapEntry)) &&
+            fdatasync(snap_fd) == 0;
+  if (snap_fd >= 0) {
+    ok = close(snap_fd) == 0 && ok;
+  }
+  free(entries);
+
+  // Publish the snapshot, then drop what it replaces
+  ok = ok && rename(tmp_path, path) == 0 && wal_sync_dir(log->dir);
+  if (ok) {
+    wal_remove_older(log->dir, generation);
+  }
+  return ok;
+}
+
+/*
+The function wal_get_stats copies the counters under the lock.
+*/
+WalStats wal_get_stats(WalLog *log) {
+  pthread_mutex_lock(&log->lock);
+  WalStats stats = log->stats;
+  pthread_mutex_unlock(&log->lock);
+  return stats;
+}
+
+/*
+The function wal_close lets the flusher write what is left, then stops it and
+frees the journal.
+*/
+bool wal_close(WalLog *log) {
+  pthread_mutex_lock(&log->lock);
+  log->stop = true;
+  pthread_cond_signal(&log->filled);
+  pthread_mutex_unlock(&log->lock);
+  pthread_join(log->flusher, NULL);
+
+  bool ok = !log->failed && log->durable_seq == log->appended_seq;
+  ok = close(log->fd) == 0 && ok;
+  pthread_cond_destroy(&log->filled);
+  pthread_cond_destroy(&log->synced);
+  pthread_mutex_destroy(&log->lock);
+  free(log->buffers[0]);
+  free(log->buffers[1]);
+  log->buffers[0] = NULL;
+  log->buffers[1] = NULL;
+  return ok;
+}
+
+/*
+The function wal_recover rebuilds the session table:
+  - The newest snapshot is mapped and its checksum and entries are checked.
+  - The segments from the snapshot on are mapped and the batch headers are
+    walked; a header that is cut off or not a batch ends its segment.
+  - The threads check the batch checksums and replay the records, see
+    wal_replay_thread.
+The files are read in place through mmap, nothing is copied.
+*/
+bool wal_recover(const char *dir, WalSession *sessions, const uint32_t count,
+                 uint threads, WalRecovery *info) {
+  WalRecovery found = {0};
+  WalDir files;
+  if (!wal_read_dir(dir, &files)) {
+    return false;
+  }
+  if (threads < 1) {
+    threads = 1;
+  } else if (threads > WAL_MAX_THREADS) {
+    threads = WAL_MAX_THREADS;
+  }
+
+  WalReplay replay = {.sessions = sessions, .count = count, .threads = threads};
+  WalMap snap = {NULL, 0};
+  WalMap *segments = calloc(files.segment_count + 1, sizeof(WalMap));
+  uint64_t *natural_end = calloc(files.segment_count + 1, sizeof(uint64_t));
+  bool *cut = calloc(files.segment_count + 1, sizeof(bool));
+  replay.segment_end = calloc(files.segment_count + 1, sizeof(uint64_t));
+  WalFound *batches = NULL;
+  uint64_t capacity = 0;
+  char path[512];
+  bool ok = segments != NULL && natural_end != NULL && cut != NULL &&
+            replay.segment_end != NULL;
+
+  // Check the snapshot
+  uint64_t start = wal_ns();
+  if (ok && files.snapshot != 0) {
+    snprintf(path, sizeof(path), "%s/snap.%lu", dir,
+             (unsigned long)files.snapshot);
+    ok = wal_map(path, &snap) && snap.size >= sizeof(WalSnapHeader);
+    const WalSnapHeader *header = (const WalSnapHeader *)snap.data;
+    ok = ok && header->magic == WAL_SNAP_MAGIC &&
+         header->version == WAL_VERSION && header->rows == ROWS &&
+         header->cols == COLS &&
+         snap.size == sizeof(WalSnapHeader) +
+                          (uint64_t)header->entry_count * sizeof(WalSnapEntry);
+    if (ok) {
+      replay.entries = (const WalSnapEntry *)(header + 1);
+      replay.entry_count = header->entry_count;
+      ok = wal_crc(replay.entries,
+                   replay.entry_count * sizeof(WalSnapEntry)) == header->crc;
+    }
+    // Entries are sorted and inside the table
+    for (uint32_t i = 0; ok && i < replay.entry_count; i++) {
+      ok = replay.entries[i].session < count &&
+           (i == 0 || replay.entries[i].session > replay.entries[i - 1].session);
+    }
+    found.snapshot_generation = files.snapshot;
+    found.snapshot_entries = replay.entry_count;
+  }
+  found.load_ns = wal_ns() - start;
+
+  // Walk the batch headers of every segment
+  start = wal_ns();
+  for (uint32_t seg = 0; ok && seg < files.segment_count; seg++) {
+    snprintf(path, sizeof(path), "%s/wal.%lu", dir,
+             (unsigned long)files.segments[seg]);
+    ok = wal_map(path, &segments[seg]);
+    size_t offset = 0;
+    while (ok && offset + sizeof(WalBatch) <= segments[seg].size) {
+      const WalBatch *batch =
+          (const WalBatch *)(segments[seg].data + offset);
+      size_t size = sizeof(WalBatch) + (size_t)batch->count * sizeof(WalRecord);
+      if (batch->magic != WAL_MAGIC || batch->count == 0 ||
+          batch->count > WAL_BATCH_RECORDS ||
+          offset + size > segments[seg].size) {
+        break;
+      }
+      if (replay.batch_count == capacity) {
+        capacity = capacity ? capacity * 2 : 1024;
+        WalFound *grown = realloc(batches, capacity * sizeof(WalFound));
+        if (grown == NULL) {
+          ok = false;
+          break;
+        }
+        batches = grown;
+      }
+      batches[replay.batch_count++] = (WalFound){batch, seg};
+      offset += size;
+    }
+    // Bytes left after the last batch are a torn batch
+    cut[seg] = offset != segments[seg].size;
+    natural_end[seg] = replay.batch_count;
+    replay.segment_end[seg] = replay.batch_count;
+  }
+  replay.batches = batches;
+  found.scan_ns = wal_ns() - start;
+
+  // Check and replay the batches on the threads. The threads wait on
+  // start_lock, so a thread that cannot be created only shrinks the split and
+  // the barrier instead of leaving the others waiting for it.
+  start = wal_ns();
+  if (ok) {
+    WalWorker workers[WAL_MAX_THREADS];
+    uint started = 1;
+    pthread_mutex_init(&replay.start_lock, NULL);
+    pthread_mutex_lock(&replay.start_lock);
+    for (uint t = 1; t < threads; t++) {
+      workers[t] = (WalWorker){.replay = &replay, .index = t};
+      if (pthread_create(&workers[t].thread, NULL, wal_replay_thread,
+                         &workers[t]) != 0) {
+        break;
+      }
+      started++;
+    }
+    replay.threads = started;
+    pthread_barrier_init(&replay.barrier, NULL, started);
+    pthread_mutex_unlock(&replay.start_lock);
+
+    workers[0] = (WalWorker){.replay = &replay, .index = 0};
+    wal_replay_thread(&workers[0]);
+    for (uint t = 1; t < started; t++) {
+      pthread_join(workers[t].thread, NULL);
+    }
+    pthread_barrier_destroy(&replay.barrier);
+    pthread_mutex_destroy(&replay.start_lock);
+    found.threads = started;
+    ok = !replay.bad;
+  }
+  found.replay_ns = wal_ns() - start;
+
+  // Count what was replayed
+  for (uint32_t seg = 0; seg < files.segment_count; seg++) {
+    uint64_t first = seg ? natural_end[seg - 1] : 0;
+    if (cut[seg] || replay.segment_end[seg] < natural_end[seg]) {
+      found.torn++;
+    }
+    for (uint64_t b = first; b < replay.segment_end[seg]; b++) {
+      found.records += batches[b].batch->count;
+      found.batches++;
+    }
+  }
+  found.segments = files.segment_count;
+  found.next_generation = files.max_generation + 1;
+
+  // Release the mappings
+  for (uint32_t seg = 0; seg < files.segment_count; seg++) {
+    wal_unmap(&segments[seg]);
+  }
+  wal_unmap(&snap);
+  free(batches);
+  free(replay.segment_end);
+  free(natural_end);
+  free(cut);
+  free(segments);
+  free(files.segments);
+  if (info != NULL) {
+    *info = found;
+  }
+  return ok;
+}
@@ -0,0 +1,325 @@
+#ifndef __WAL_H__
+#define __WAL_H__
+
+#include "game.h"
+#include <pthread.h>
+#include <stdint.h>
+
+// Durable game sessions for a host serving many players (host only)
+// Every move is appended to a journal as a fixed size binary record. Records
+// are collected in batches and a flusher thread writes each batch with one
+// write and one fdatasync (group commit): the moves that arrive while a sync
+// runs share the next one. A client answers the player once wal_wait says the
+// record of the move is on disk.
+//
+// Files in the journal directory (little endian):
+//   wal.<gen>   journal segment: WalBatch header followed by WalBatch.count
+//               WalRecord, repeated
+//   snap.<gen>  WalSnapHeader followed by one WalSnapEntry per active session,
+//               the state after every segment older than gen
+// A snapshot moves the journal to a new segment and deletes the older files,
+// so recovery loads the newest snapshot and replays the segments from its
+// generation on. A batch with a bad header or checksum was torn by a crash
+// before its sync returned, so no client was answered for it; it ends the
+// replay of its segment.
+
+#define WAL_MAGIC 0x4C415754u      // "TWAL", start of every batch
+#define WAL_SNAP_MAGIC 0x50414E53u // "SNAP", start of a snapshot
+#define WAL_VERSION 1              // Version of the file layouts
+#ifndef WAL_BATCH_RECORDS
+#define WAL_BATCH_RECORDS 8192     // Maximum records per group commit
+#endif
+#define WAL_MAX_THREADS 64         // Maximum number of recovery threads
+
+// Record types
+#define WAL_MOVE 1  // A piece was placed at cell
+#define WAL_RESET 2 // The board was emptied, X moves first
+
+// Record flags
+#define WAL_GAME_OVER 1 // The move won the game
+
+// Struct for storing one journal record
+// @field session index of the session in the session table
+// @field type WAL_MOVE or WAL_RESET
+// @field cell cell index of the move, row * COLS + col
+// @field player player who moved
+// @field flags WAL_GAME_OVER if the move won the game
+typedef struct {
+  uint32_t session;
+  uint8_t type;
+  uint8_t cell;
+  char player;
+  uint8_t flags;
+} WalRecord;
+
+// Struct for storing the header of one group commit
+// @field magic WAL_MAGIC
+// @field count number of records following the header
+// @field first_seq sequence number of the first record
+// @field crc CRC-32 of the records
+// @field reserved zero
+typedef struct {
+  uint32_t magic;
+  uint32_t count;
+  uint64_t first_seq;
+  uint32_t crc;
+  uint32_t reserved;
+} WalBatch;
+
+// Struct for storing the snapshot file header
+// @field magic WAL_SNAP_MAGIC
+// @field version WAL_VERSION
+// @field rows number of rows of the board
+// @field cols number of columns of the board
+// @field generation first journal segment not included in the snapshot
+// @field entry_count number of entries
+// @field crc CRC-32 of the entries
+// @field reserved zero
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint8_t rows;
+  uint8_t cols;
+  uint32_t generation;
+  uint32_t entry_count;
+  uint32_t crc;
+  uint32_t reserved;
+} WalSnapHeader;
+
+// Struct for storing one active session in a snapshot
+// @field session index of the session in the session table
+// @field current_player player to move
+// @field moves cursor position
+// @field is_game_over true once a player has won
+// @field reserved zero
+// @field x cells occupied by X, bit index is row * COLS + col
+// @field o cells occupied by O
+typedef struct {
+  uint32_t session;
+  char current_player;
+  uint8_t moves;
+  uint8_t is_game_over;
+  uint8_t reserved;
+  uint64_t x;
+  uint64_t o;
+} WalSnapEntry;
+
+_Static_assert(sizeof(WalRecord) == 8, "WalRecord layout");
+_Static_assert(sizeof(WalBatch) == 24, "WalBatch layout");
+_Static_assert(sizeof(WalSnapHeader) == 24, "WalSnapHeader layout");
+_Static_assert(sizeof(WalSnapEntry) == 24, "WalSnapEntry layout");
+
+// Struct for storing the game state of one hosted session
+// @field board the tic-tac-toe board
+// @field current_player the player to move
+// @field moves the cursor position
+// @field is_game_over true once a player has won
+typedef struct {
+  char board[ROWS][COLS];
+  char current_player;
+  uint moves;
+  bool is_game_over;
+} WalSession;
+
+// Struct for storing the journal counters
+// @field records number of records made durable
+// @field commits number of group commits (one write and one fdatasync each)
+// @field bytes number of bytes written
+// @field sync_ns time spent in write and fdatasync
+// @field latency_ns sum over the records of the time from wal_append to
+// durable
+// @field max_latency_ns longest time from wal_append to durable
+// @field max_batch largest number of records in one commit
+typedef struct {
+  uint64_t records;
+  uint64_t commits;
+  uint64_t bytes;
+  uint64_t sync_ns;
+  uint64_t latency_ns;
+  uint64_t max_latency_ns;
+  uint32_t max_batch;
+} WalStats;
+
+// Struct for storing an open journal
+// @field dir journal directory
+// @field fd file of the current segment
+// @field generation generation of the current segment
+// @field lock protects every field below
+// @field filled signalled when the first record of a batch is appended
+// @field synced signalled after every commit
+// @field flusher thread writing the batches
+// @field buffers the batch being filled and the batch being written
+// @field fill index of the buffer being filled
+// @field fill_count number of records in the buffer being filled
+// @field fill_first_ns time the first record of the filling batch was appended
+// @field fill_sum_ns sum of the append times of the filling batch
+// @field appended_seq sequence number of the last record appended
+// @field durable_seq sequence number of the last record on disk
+// @field failed true once a write or sync failed, nothing is durable after it
+// @field stop true when the flusher must exit
+// @field stats journal counters
+typedef struct {
+  char dir[256];
+  int fd;
+  uint32_t generation;
+  pthread_mutex_t lock;
+  pthread_cond_t filled;
+  pthread_cond_t synced;
+  pthread_t flusher;
+  WalRecord *buffers[2];
+  uint fill;
+  uint32_t fill_count;
+  uint64_t fill_first_ns;
+  uint64_t fill_sum_ns;
+  uint64_t appended_seq;
+  uint64_t durable_seq;
+  bool failed;
+  bool stop;
+  WalStats stats;
+} WalLog;
+
+// Struct for storing what wal_recover found
+// @field snapshot_generation generation of the snapshot loaded, 0 if none
+// @field snapshot_entries number of sessions loaded from the snapshot
+// @field segments number of journal segments replayed
+// @field batches number of batches replayed
+// @field records number of records replayed
+// @field torn number of segments that ended with a torn batch
+// @field next_generation generation to pass to wal_open
+// @field threads number of threads that replayed the journal, fewer than
+// asked for if some could not be created
+// @field load_ns time spent checking and loading the snapshot
+// @field scan_ns time spent finding the batches
+// @field replay_ns time spent checking and replaying the batches
+typedef struct {
+  uint32_t snapshot_generation;
+  uint64_t snapshot_entries;
+  uint32_t segments;
+  uint64_t batches;
+  uint64_t records;
+  uint32_t torn;
+  uint32_t next_generation;
+  uint threads;
+  uint64_t load_ns;
+  uint64_t scan_ns;
+  uint64_t replay_ns;
+} WalRecovery;
+
+// ----------------------------------------
+// Session functions
+// ----------------------------------------
+
+/**
+ * @brief Builds the CRC table; must be called once before any other journal
+ * function
+ */
+void wal_init(void);
+
+/**
+ * @brief Empties a session board, X moves first
+ *
+ * @param session Pointer to the session
+ */
+void wal_session_reset(WalSession *session);
+
+/**
+ * @brief Applies one record to a session
+ *
+ * Moves are entered with place_piece, like a BTN2 press but without printing
+ * and without the shared state of the game, so recovery threads can apply
+ * records in parallel.
+ *
+ * @param session Pointer to the session
+ * @param record The record
+ */
+void wal_session_apply(WalSession *session, const WalRecord *record);
+
+// ----------------------------------------
+// Journal functions
+// ----------------------------------------
+
+/**
+ * @brief Creates a journal segment and starts the flusher thread
+ *
+ * @param log Pointer to the journal
+ * @param dir Journal directory, must exist
+ * @param generation Generation of the segment, next_generation of
+ * wal_recover or 1 for an empty directory
+ * @return true on success, false otherwise.
+ */
+bool wal_open(WalLog *log, const char *dir, const uint32_t generation);
+
+/**
+ * @brief Appends a record to the batch being filled
+ *
+ * Blocks while the batch is full and the previous one is being written.
+ * Thread safe.
+ *
+ * @param log Pointer to the journal
+ * @param record The record
+ * @return The sequence number of the record, 0 if the journal failed.
+ */
+uint64_t wal_append(WalLog *log, const WalRecord *record);
+
+/**
+ * @brief Waits until a record is on disk
+ *
+ * Thread safe.
+ *
+ * @param log Pointer to the journal
+ * @param seq Sequence number returned by wal_append
+ * @return true once the record is durable, false if the journal failed.
+ */
+bool wal_wait(WalLog *log, const uint64_t seq);
+
+/**
+ * @brief Writes a snapshot of the sessions and moves the journal to a new
+ * segment
+ *
+ * Every appended record must be applied to sessions and no record may be
+ * appended while the snapshot is taken. The older segments and snapshots are
+ * deleted once the new snapshot is on disk.
+ *
+ * @param log Pointer to the journal
+ * @param sessions The session table
+ * @param count Number of sessions in the table
+ * @return true on success, false otherwise.
+ */
+bool wal_snapshot(WalLog *log, const WalSession *sessions,
+                  const uint32_t count);
+
+/**
+ * @brief Returns a copy of the journal counters
+ *
+ * @param log Pointer to the journal
+ * @return The counters.
+ */
+WalStats wal_get_stats(WalLog *log);
+
+/**
+ * @brief Writes the last batch, stops the flusher and closes the segment
+ *
+ * @param log Pointer to the journal
+ * @return true if every record is durable, false otherwise.
+ */
+bool wal_close(WalLog *log);
+
+/**
+ * @brief Rebuilds the sessions from the newest snapshot and the journal
+ *
+ * The session table is split in one range per thread; every thread replays
+ * the records of its own sessions in journal order.
+ *
+ * @param dir Journal directory
+ * @param sessions The session table, filled in
+ * @param count Number of sessions in the table
+ * @param threads Number of threads, 1 to WAL_MAX_THREADS; fewer are used if
+ * some cannot be created
+ * @param info Receives what was found, may be NULL
+ * @return true on success, false if a file could not be read or a snapshot or
+ * record does not fit the table.
+ */
+bool wal_recover(const char *dir, WalSession *sessions, const uint32_t count,
+                 uint threads, WalRecovery *info);
+
+#endif
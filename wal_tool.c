@@ -0,0 +1,349 @@
+#include "wal.h"
+#include "bitboard.h"
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Session journal tool (host build only)
+//   wal_tool bench DIR [SESSIONS] [ROUNDS] [CLIENTS] [THREADS]
+//       Plays ROUNDS moves (default 10) in each of SESSIONS sessions (default
+//       1000000) from CLIENTS client threads (default 4), with a snapshot every
+//       WAL_TOOL_SNAP_ROUNDS rounds, then recovers the sessions with 1 and
+//       THREADS threads (default 4) and checks them against the live table.
+//       Prints the commit latency, the throughput and the recovery time per
+//       million sessions.
+//   wal_tool recover DIR SESSIONS [THREADS]
+//       Recovers the sessions of a journal, e.g. after killing a bench.
+
+#define WAL_TOOL_SNAP_ROUNDS 4 // Rounds between two snapshots
+#define WAL_TOOL_WINDOW 1024   // Records a client appends before waiting
+
+// Struct for storing one client thread
+// @field log the journal
+// @field sessions the live session table
+// @field first first session of the client
+// @field last one past the last session of the client
+// @field rng state of the xorshift random generator
+// @field wins number of games the client won
+// @field ties number of games the client tied
+// @field ok false if the journal failed
+// @field thread the thread
+typedef struct {
+  WalLog *log;
+  WalSession *sessions;
+  uint32_t first;
+  uint32_t last;
+  uint32_t rng;
+  uint32_t wins;
+  uint32_t ties;
+  bool ok;
+  pthread_t thread;
+} ToolClient;
+
+// ----------------------------------------
+// Helpers
+// ----------------------------------------
+
+/*
+The function tool_ns reads the monotonic clock in nanoseconds.
+*/
+static uint64_t tool_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+The function tool_rand is a xorshift32 generator.
+*/
+static uint32_t tool_rand(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+/*
+The function tool_clean deletes the journal files left in the directory by an
+earlier run.
+*/
+static void tool_clean(const char *dir) {
+  DIR *d = opendir(dir);
+  if (d == NULL) {
+    return;
+  }
+  char path[512];
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL) {
+    if (strncmp(e->d_name, "wal.", 4) == 0 ||
+        strncmp(e->d_name, "snap.", 5) == 0) {
+      snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+      unlink(path);
+    }
+  }
+  closedir(d);
+}
+
+/*
+The function tool_play journals a record and applies it to its session, the
+way a server handles a move before answering the player.
+*/
+static uint64_t tool_play(WalLog *log, WalSession *session,
+                          const WalRecord *record) {
+  uint64_t seq = wal_append(log, record);
+  wal_session_apply(session, record);
+  return seq;
+}
+
+/*
+The function tool_client plays one move in each session of the client. A game
+that is over is reset, as with BTN3, and a full board after a move without a
+winner is reset, as in handle_btn2. The client waits for the journal every
+WAL_TOOL_WINDOW records, like a server with that many answers in flight.
+*/
+static void *tool_client(void *arg) {
+  ToolClient *c = arg;
+  uint64_t seq = 0;
+  uint32_t pending = 0;
+
+  for (uint32_t s = c->first; s < c->last && c->ok; s++) {
+    WalSession *session = &c->sessions[s];
+    WalRecord record = {.session = s, .type = WAL_RESET};
+
+    if (!session->is_game_over) {
+      // Pick a random empty cell
+      Bitboard bb;
+      bb_from_board((const char(*)[COLS])session->board, &bb);
+      BbMask empty = bb_empty(&bb);
+      uint skip = tool_rand(&c->rng) % __builtin_popcountll(empty);
+      while (skip-- > 0) {
+        empty &= empty - 1;
+      }
+      uint cell = __builtin_ctzll(empty);
+
+      // Play it and find out if it won
+      bb_place(&bb, session->current_player, cell);
+      record.type = WAL_MOVE;
+      record.cell = cell;
+      record.player = session->current_player;
+      record.flags =
+          bb_is_win_at(bb_pieces(&bb, record.player), cell) ? WAL_GAME_OVER : 0;
+      seq = tool_play(c->log, session, &record);
+      pending++;
+      c->wins += record.flags != 0;
+
+      // A tie resets the board
+      if (!record.flags && bb_empty(&bb) == 0) {
+        c->ties++;
+        record = (WalRecord){.session = s, .type = WAL_RESET};
+        seq = tool_play(c->log, session, &record);
+        pending++;
+      }
+    } else {
+      seq = tool_play(c->log, session, &record);
+      pending++;
+    }
+
+    if (pending >= WAL_TOOL_WINDOW) {
+      c->ok = wal_wait(c->log, seq);
+      pending = 0;
+    }
+  }
+  if (c->ok && seq != 0) {
+    c->ok = wal_wait(c->log, seq);
+  }
+  return NULL;
+}
+
+/*
+The function tool_same compares two sessions field by field.
+*/
+static bool tool_same(const WalSession *a, const WalSession *b) {
+  return memcmp(a->board, b->board, sizeof(a->board)) == 0 &&
+         a->current_player == b->current_player && a->moves == b->moves &&
+         a->is_game_over == b->is_game_over;
+}
+
+/*
+The function tool_recover recovers the journal and prints the time of each
+step, scaled to one million sessions. What was found is stored in info.
+*/
+static bool tool_recover(const char *dir, WalSession *sessions,
+                         const uint32_t count, const uint threads,
+                         WalRecovery *found) {
+  WalRecovery info = {0};
+  uint64_t start = tool_ns();
+  bool ok = wal_recover(dir, sessions, count, threads, &info);
+  uint64_t elapsed = tool_ns() - start;
+  if (found != NULL) {
+    *found = info;
+  }
+
+  // Nanoseconds to milliseconds per million sessions
+  double scale = 1.0 / count;
+  printf("recover %u threads: %s, snapshot %lu (%llu sessions), %u segments, "
+         "%llu batches, %llu records, %u torn\n",
+         info.threads, ok ? "ok" : "FAILED",
+         (unsigned long)info.snapshot_generation,
+         (unsigned long long)info.snapshot_entries, info.segments,
+         (unsigned long long)info.batches, (unsigned long long)info.records,
+         info.torn);
+  printf("recover %u threads: %.1f ms, per million sessions %.1f ms (snapshot "
+         "%.1f, scan %.1f, replay %.1f)\n",
+         info.threads, elapsed / 1e6, elapsed * scale, info.load_ns * scale,
+         info.scan_ns * scale, info.replay_ns * scale);
+  return ok;
+}
+
+// ----------------------------------------
+// bench
+// ----------------------------------------
+
+/*
+The function tool_bench plays the rounds, snapshots the table every
+WAL_TOOL_SNAP_ROUNDS rounds, then recovers the journal and checks that every
+session came back as it was. So that the check covers more than empty boards,
+a run long enough for a game to be won must have won one and, when a snapshot
+was taken, loaded sessions from it.
+*/
+static int tool_bench(const char *dir, const uint32_t count,
+                      const uint rounds, uint clients, const uint threads) {
+  mkdir(dir, 0755);
+  tool_clean(dir);
+  if (clients < 1) {
+    clients = 1;
+  }
+
+  WalSession *live = malloc(count * sizeof(WalSession));
+  WalSession *recovered = malloc(count * sizeof(WalSession));
+  ToolClient *client = calloc(clients, sizeof(ToolClient));
+  if (live == NULL || recovered == NULL || client == NULL) {
+    return 1;
+  }
+  for (uint32_t s = 0; s < count; s++) {
+    wal_session_reset(&live[s]);
+  }
+
+  WalLog log;
+  if (!wal_open(&log, dir, 1)) {
+    fprintf(stderr, "wal_tool: cannot create a journal in %s\n", dir);
+    return 1;
+  }
+
+  // Play the rounds from the clients
+  bool ok = true;
+  uint64_t snap_ns = 0;
+  uint snapshots = 0;
+  uint64_t wins = 0;
+  uint64_t ties = 0;
+  uint64_t start = tool_ns();
+  for (uint round = 1; round <= rounds && ok; round++) {
+    for (uint i = 0; i < clients; i++) {
+      client[i] = (ToolClient){.log = &log,
+                               .sessions = live,
+                               .first = (uint64_t)count * i / clients,
+                               .last = (uint64_t)count * (i + 1) / clients,
+                               .rng = 0x9e3779b9u * (round * clients + i + 1),
+                               .ok = true};
+      pthread_create(&client[i].thread, NULL, tool_client, &client[i]);
+    }
+    for (uint i = 0; i < clients; i++) {
+      pthread_join(client[i].thread, NULL);
+      ok = ok && client[i].ok;
+      wins += client[i].wins;
+      ties += client[i].ties;
+    }
+
+    // Snapshot between two rounds, while no client appends
+    if (ok && round % WAL_TOOL_SNAP_ROUNDS == 0) {
+      uint64_t snap_start = tool_ns();
+      ok = wal_snapshot(&log, live, count);
+      snap_ns += tool_ns() - snap_start;
+      snapshots++;
+    }
+  }
+  uint64_t elapsed = tool_ns() - start;
+  ok = wal_close(&log) && ok;
+
+  // Journal results, the snapshots are not part of the throughput
+  WalStats st = log.stats;
+  double seconds = (elapsed - snap_ns) / 1e9;
+  printf("journal: %s, %llu records in %llu commits (avg %.1f, max %lu per "
+         "commit), %.1f MB\n",
+         ok ? "ok" : "FAILED", (unsigned long long)st.records,
+         (unsigned long long)st.commits,
+         st.commits ? (double)st.records / st.commits : 0.0,
+         (unsigned long)st.max_batch, st.bytes / 1e6);
+  printf("journal: %.0f records/s, %.0f commits/s, sync avg %.0f us\n",
+         st.records / seconds, st.commits / seconds,
+         st.commits ? st.sync_ns / 1e3 / st.commits : 0.0);
+  printf("commit latency: avg %.0f us, max %.0f us\n",
+         st.records ? st.latency_ns / 1e3 / st.records : 0.0,
+         st.max_latency_ns / 1e3);
+  printf("games: %llu won, %llu tied\n", (unsigned long long)wins,
+         (unsigned long long)ties);
+  if (rounds >= 2 * WIN_LENGTH - 1 && wins == 0) {
+    fprintf(stderr, "wal_tool: no game was won\n");
+    ok = false;
+  }
+  if (snapshots > 0) {
+    printf("snapshot: %u taken, avg %.1f ms, per million sessions %.1f ms\n",
+           snapshots, snap_ns / 1e6 / snapshots,
+           snap_ns / 1e6 / snapshots * 1e6 / count);
+  }
+
+  // Recover with one thread, then in parallel, and compare with the live table
+  uint thread_counts[2] = {1, threads};
+  for (uint i = 0; i < (threads > 1 ? 2u : 1u) && ok; i++) {
+    WalRecovery info;
+    ok = tool_recover(dir, recovered, count, thread_counts[i], &info);
+    if (ok && snapshots > 0 && info.snapshot_entries == 0) {
+      fprintf(stderr, "wal_tool: the snapshot holds no session\n");
+      ok = false;
+    }
+    uint32_t mismatches = 0;
+    for (uint32_t s = 0; s < count; s++) {
+      mismatches += !tool_same(&live[s], &recovered[s]);
+    }
+    printf("recover %u threads: %lu sessions differ\n", info.threads,
+           (unsigned long)mismatches);
+    ok = ok && mismatches == 0;
+  }
+
+  free(client);
+  free(recovered);
+  free(live);
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  bb_init();
+  wal_init();
+
+  if (argc >= 3 && strcmp(argv[1], "bench") == 0) {
+    uint32_t count = argc > 3 ? strtoul(argv[3], NULL, 0) : 1000000;
+    uint rounds = argc > 4 ? (uint)strtoul(argv[4], NULL, 0) : 10;
+    uint clients = argc > 5 ? (uint)strtoul(argv[5], NULL, 0) : 4;
+    uint threads = argc > 6 ? (uint)strtoul(argv[6], NULL, 0) : 4;
+    return tool_bench(argv[2], count ? count : 1, rounds, clients, threads);
+  }
+  if (argc >= 4 && strcmp(argv[1], "recover") == 0) {
+    uint32_t count = strtoul(argv[3], NULL, 0);
+    uint threads = argc > 4 ? (uint)strtoul(argv[4], NULL, 0) : 4;
+    WalSession *sessions = malloc((count ? count : 1) * sizeof(WalSession));
+    bool ok = sessions != NULL &&
+              tool_recover(argv[2], sessions, count ? count : 1, threads, NULL);
+    free(sessions);
+    return ok ? 0 : 1;
+  }
+
+  fprintf(stderr,
+          "usage: %s bench DIR [SESSIONS] [ROUNDS] [CLIENTS] [THREADS]\n"
+          "       %s recover DIR SESSIONS [THREADS]\n",
+          argv[0], argv[0]);
+  return 2;
+}